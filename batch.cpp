@@ -0,0 +1,346 @@
+#include "batch.h"
+#include "queue.h"
+#include "labelmap.h"
+#include "temporal.h"
+#include "render.h"
+#include "tiled.h"
+#include "util.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <map>
+#include <algorithm>
+
+#include <dirent.h>
+
+struct Job {
+	std::string input;
+	Image img;
+	SlicResult result;
+
+	Job(const std::string &input)
+		: input(input), img(0, 0) {}
+};
+
+typedef std::unique_ptr<Job> JobPtr;
+
+static bool hasSuffix(const std::string &str, const std::string &suffix)
+{
+	return str.size() >= suffix.size() &&
+		str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Whether <name> looks like the output of an image next to it, see
+// outputPath().
+static bool isOutput(const std::string &name)
+{
+	std::string stem = name.substr(0, name.size() - 4);
+	return hasSuffix(stem, "_sp") || hasSuffix(stem, "_contours") || hasSuffix(stem, "_labels");
+}
+
+std::vector<std::string> listImages(const std::string &dir, bool skipOutputs)
+{
+	std::vector<std::string> files;
+
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		println("[listImages error]: Could not open " << dir);
+		return files;
+	}
+
+	while (struct dirent *entry = readdir(d)) {
+		std::string name = entry->d_name;
+		bool image = hasSuffix(name, ".png") || hasSuffix(name, ".ppm") || hasSuffix(name, ".pam");
+		if (image && !(skipOutputs && isOutput(name)))
+			files.push_back(dir + "/" + name);
+	}
+
+	closedir(d);
+	std::sort(files.begin(), files.end());
+
+	return files;
+}
+
+// Where to write the output of <input>. <tag> tells the review renders
+// apart from the main output, which has none.
+static std::string outputPath(const std::string &input, const BatchOptions &options,
+		const char *tag = nullptr)
+{
+	bool known = hasSuffix(input, ".png") || hasSuffix(input, ".ppm") || hasSuffix(input, ".pam");
+	std::string stem = input.substr(0, input.size() - (known ? 4 : 0));
+	std::string extension = options.labelMaps && !tag ? ".splm" : options.ppm ? ".ppm" : ".png";
+
+	if (options.outputDir.empty())
+		return stem + (tag ? tag : "_sp") + extension;
+
+	size_t slash = stem.find_last_of('/');
+	std::string name = slash == std::string::npos ? stem : stem.substr(slash + 1);
+	return options.outputDir + "/" + name + (tag ? tag : "") + extension;
+}
+
+// Every file written for <input>: the main output and, with review, the
+// renders. Bands only render the labels, and always to PPM.
+static std::vector<std::string> outputPaths(const std::string &input, const BatchOptions &options)
+{
+	BatchOptions written = options;
+	if (options.bandRows) {
+		written.labelMaps = true;
+		written.ppm = true;
+	}
+
+	std::vector<std::string> paths = {outputPath(input, written)};
+	if (options.review && !options.bandRows)
+		paths.push_back(outputPath(input, written, "_contours"));
+	if (options.review)
+		paths.push_back(outputPath(input, written, "_labels"));
+
+	return paths;
+}
+
+template <typename F>
+static void runPool(unsigned threads, F fn)
+{
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < std::max(threads, 1u); ++t) {
+		pool.push_back(std::thread(fn));
+	}
+
+	for (auto &thread : pool) {
+		thread.join();
+	}
+}
+
+// Segments one image in bands, and writes each band as it comes.
+static bool segmentBands(const std::string &input, const BatchOptions &options,
+		std::vector<unsigned char> &palette, std::vector<unsigned char> &colors)
+{
+	if (!hasSuffix(input, ".ppm") && !hasSuffix(input, ".pam")) {
+		println("[runBatch error]: Bands need PPM or PAM input, skipping " << input);
+		return false;
+	}
+
+	PpmRowReader reader(input.c_str());
+	if (!reader.width)
+		return false;
+
+	// Neither can be written a band at a time as PNG.
+	BatchOptions tiled = options;
+	tiled.labelMaps = true;
+	tiled.ppm = true;
+
+	const int32_t n = tiledLabels(reader.width, reader.height, options.params);
+	const std::string output = outputPath(input, tiled);
+
+	LabelMapWriter writer;
+	bool ok = writer.open(output.c_str(), reader.width, reader.height, n);
+
+	FILE *review = nullptr;
+	if (ok && options.review) {
+		std::string path = outputPath(input, tiled, "_labels");
+		review = fopen(path.c_str(), "wb");
+		if (!review)
+			println("[runBatch error]: Could not open " << path);
+
+		ok = review && fprintf(review, "P6\n%u %u\n255\n", reader.width, reader.height) > 0;
+		falseColorPalette(n, palette);
+	}
+
+	ok = ok && segmentTiled(reader, options.params, options.bandRows,
+		[&](unsigned, unsigned rows, const int32_t *labels, const unsigned char *rgb) {
+			if (!writer.write(rows, labels, rgb))
+				return false;
+			if (!review)
+				return true;
+
+			size_t pixels = (size_t) rows * reader.width;
+			colors.resize(3 * pixels);
+			fillLabels(labels, pixels, palette, colors.data());
+			return fwrite(colors.data(), 3, pixels, review) == pixels;
+		}) >= 0;
+
+	ok = writer.close() && ok;
+	if (review)
+		ok = fclose(review) == 0 && ok;
+
+	if (ok && options.verbose)
+		println(input << " -> " << output);
+
+	return ok;
+}
+
+// Drops the inputs that would write a file another input writes as well,
+// e.g. a/x.png and b/x.png into the same output directory, or x.png and
+// x.ppm next to each other. Also drops those that would overwrite an
+// input, e.g. x.png next to x_sp.png, which is then still segmented.
+// Paths are compared as given. Returns how many were dropped.
+static int dropCollisions(std::vector<std::string> &inputs, const BatchOptions &options)
+{
+	std::map<std::string, std::vector<size_t>> outputs;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		for (const std::string &path : outputPaths(inputs[i], options)) {
+			outputs[path].push_back(i);
+		}
+	}
+
+	std::vector<uint8_t> drop(inputs.size(), 0);
+	for (const std::string &input : inputs) {
+		auto output = outputs.find(input);
+		if (output == outputs.end())
+			continue;
+
+		for (size_t i : output->second) {
+			if (!drop[i])
+				println("[runBatch error]: " << inputs[i] << " would overwrite the input " << input
+					<< ", skipping it");
+			drop[i] = 1;
+		}
+	}
+
+	// Those are not written at all, so they cannot collide.
+	const std::vector<uint8_t> overwrites = drop;
+
+	for (auto &output : outputs) {
+		std::vector<size_t> writers;
+		for (size_t i : output.second) {
+			if (!overwrites[i])
+				writers.push_back(i);
+		}
+
+		if (writers.size() < 2)
+			continue;
+
+		std::string names;
+		for (size_t i : writers) {
+			names += (names.empty() ? "" : ", ") + inputs[i];
+			drop[i] = 1;
+		}
+
+		println("[runBatch error]: " << names << " would all be written to " << output.first
+			<< ", skipping them");
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		if (!drop[i])
+			inputs[kept++] = inputs[i];
+	}
+
+	int dropped = inputs.size() - kept;
+	inputs.resize(kept);
+	return dropped;
+}
+
+int runBatch(const std::vector<std::string> &all, const BatchOptions &options)
+{
+	BoundedQueue<JobPtr> decoded(options.queueSize);
+	BoundedQueue<JobPtr> segmented(options.queueSize);
+	std::atomic<size_t> next(0);
+	std::atomic<int> failures(0);
+
+	// The stages run images concurrently, so two of them writing the same
+	// file would race, and one result would be lost either way.
+	std::vector<std::string> inputs = all;
+	failures += dropCollisions(inputs, options);
+
+	// Bands are read straight from the file, so there is nothing to
+	// decode ahead, and each worker writes its own output.
+	if (options.bandRows) {
+		runPool(options.workers, [&] {
+			std::vector<unsigned char> palette, colors;
+
+			for (size_t i = next++; i < inputs.size(); i = next++) {
+				if (!segmentBands(inputs[i], options, palette, colors))
+					++failures;
+			}
+		});
+
+		return failures;
+	}
+
+	// Each stage closes the queue behind it once all of its threads are
+	// done, which lets the next stage drain it and finish.
+	// Frames have to reach the segmentation in order, and it has to see
+	// every one of them.
+	const unsigned decoders = options.temporal ? 1 : options.decoders;
+	const unsigned workers = options.temporal ? 1 : options.workers;
+
+	std::thread decode([&] {
+		runPool(decoders, [&] {
+			ImageReader reader;
+
+			for (size_t i = next++; i < inputs.size(); i = next++) {
+				JobPtr job(new Job(inputs[i]));
+				if (!reader.read(job->input.c_str(), job->img)) {
+					++failures;
+					continue;
+				}
+
+				decoded.push(std::move(job));
+			}
+		});
+		decoded.close();
+	});
+
+	std::thread segment([&] {
+		runPool(workers, [&] {
+			Slic slic(options.params);
+			TemporalSlic temporal(options.params, slic.workspace);
+			JobPtr job;
+
+			while (decoded.pop(job)) {
+				if (options.temporal) {
+					temporal.segment(job->img, job->result);
+				} else {
+					slic.segment(job->img, job->result);
+				}
+				segmented.push(std::move(job));
+			}
+		});
+		segmented.close();
+	});
+
+	runPool(options.encoders, [&] {
+		ImageWriter writer(options.png);
+		// Scratch of the review renders, reused across images.
+		Image render(0, 0);
+		std::vector<unsigned char> palette;
+		JobPtr job;
+
+		while (segmented.pop(job)) {
+			std::string output = outputPath(job->input, options);
+			bool saved = true;
+
+			if (options.review) {
+				// Before superpixelate overwrites the input.
+				static const unsigned char white[3] = {255, 255, 255};
+				renderContours(job->img, job->result, white, render);
+				saved = writer.write(outputPath(job->input, options, "_contours").c_str(), render);
+
+				falseColorPalette(job->result.clusters.size(), palette);
+				renderFill(job->result, palette, render);
+				saved = writer.write(outputPath(job->input, options, "_labels").c_str(), render) && saved;
+			}
+
+			if (options.labelMaps) {
+				saved = saveLabelMap(output.c_str(), job->result) && saved;
+			} else {
+				job->img.superpixelate(job->result);
+				saved = writer.write(output.c_str(), job->img) && saved;
+			}
+
+			if (!saved) {
+				++failures;
+				continue;
+			}
+
+			if (options.verbose)
+				println(job->input << " -> " << output);
+		}
+	});
+
+	decode.join();
+	segment.join();
+
+	return failures;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "slic.h"
+#include "io.h"
+
+struct BatchOptions {
+	SlicParams params;
+	// Where to write the superpixelated images, as <name>.png (or .ppm,
+	// .splm). If empty, they are written next to their inputs as
+	// <name>_sp.png.
+	std::string outputDir;
+	// Worker threads of the decode, segment and encode stages.
+	unsigned decoders = 1;
+	unsigned workers = 1;
+	unsigned encoders = 1;
+	// Images that may wait between two stages.
+	size_t queueSize = 4;
+	// Write binary label maps (.splm, see labelmap.h) instead of
+	// superpixelated images.
+	bool labelMaps = false;
+	// Write the images as PPM instead of PNG, and how hard to compress
+	// PNGs.
+	bool ppm = false;
+	PngSettings png;
+	// Next to every superpixelated image, also write the input with the
+	// superpixel boundaries drawn on it as <name>_contours, and the
+	// labels in false color as <name>_labels.
+	bool review = false;
+	// Above 0, segment PPM and PAM inputs in bands of this many rows, see
+	// segmentTiled(), so memory is bounded by the band instead of the
+	// image. The labels are streamed to a label map, and with <review>
+	// in false color to <name>_labels.ppm.
+	unsigned bandRows = 0;
+	// Treat the inputs as consecutive frames of a video, see
+	// TemporalSlic. Frames are then decoded and segmented one at a time,
+	// in order.
+	bool temporal = false;
+	// Print every image as it is written.
+	bool verbose = false;
+};
+
+// Lists the PNG, PPM and PAM files in <dir>, sorted by name. With
+// <skipOutputs>, leaves out the <name>_sp, <name>_contours and
+// <name>_labels files that runBatch() writes next to its inputs.
+std::vector<std::string> listImages(const std::string &dir, bool skipOutputs = false);
+
+// Segments every image in <inputs>. Decoding, segmentation and encoding
+// run as a pipeline with a pool of threads per stage and bounded queues
+// between them, so the PNG codec work of one image overlaps with the
+// segmentation of another. Inputs that would write the same file as
+// another input, review renders included, or overwrite an input are
+// skipped. Returns the number of images that failed, including those.
+int runBatch(const std::vector<std::string> &inputs, const BatchOptions &options);
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "image.h"
+#include "io.h"
+#include "slic.h"
+#include "timer.h"
+#include "metrics.h"
+#include "util.h"
+
+// Deterministic test image: smooth gradients, a grid of discs in varying
+// colors, and a little hashed noise so that no two pixels are alike.
+static Image syntheticImage(unsigned width, unsigned height)
+{
+	Image img(width, height);
+	const unsigned cell = std::max(width, height) / 16 + 1;
+
+	for (unsigned y = 0; y < height; ++y) {
+		for (unsigned x = 0; x < width; ++x) {
+			unsigned cx = x / cell, cy = y / cell;
+			double dx = (x % cell) - cell / 2.0;
+			double dy = (y % cell) - cell / 2.0;
+			bool disc = dx*dx + dy*dy < cell*cell / 9.0;
+
+			uint32_t h = (x * 73856093u) ^ (y * 19349663u);
+			int noise = (h >> 13) % 9 - 4;
+
+			unsigned char *px = &img.data[3 * ((size_t) y * width + x)];
+			if (disc) {
+				px[0] = (cx * 97 + cy * 31) % 256;
+				px[1] = (cx * 53 + cy * 151) % 256;
+				px[2] = (cx * 199 + cy * 7) % 256;
+			} else {
+				px[0] = std::min(std::max((int) (255.0 * x / width) + noise, 0), 255);
+				px[1] = std::min(std::max((int) (255.0 * y / height) + noise, 0), 255);
+				px[2] = 128 + noise;
+			}
+		}
+	}
+
+	return img;
+}
+
+static std::vector<double> parseList(const char *str)
+{
+	std::vector<double> list;
+	std::stringstream ss(str);
+	std::string item;
+
+	while (std::getline(ss, item, ',')) {
+		list.push_back(atof(item.c_str()));
+	}
+
+	return list;
+}
+
+// Lowers the peak resident set size to the current one, so that
+// peakRssMb() reports the peak of what runs after this. Only Linux can,
+// elsewhere the peak stays that of the whole process.
+static void resetPeakRss()
+{
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file) {
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
+static double peakRssMb()
+{
+	FILE *file = fopen("/proc/self/status", "r");
+	if (file) {
+		char line[256];
+		double kb = -1.0;
+		while (kb < 0.0 && fgets(line, sizeof(line), file)) {
+			sscanf(line, "VmHWM: %lf kB", &kb);
+		}
+		fclose(file);
+
+		if (kb >= 0.0)
+			return kb / 1024.0;
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+static void usage(const char *prog)
+{
+	println("usage: " << prog << " [-m MP,...] [-n N,...] [-t threads] [-i iterations] [-l] [-f]");
+	println("");
+	println("Runs decode, SLIC, render and encode on synthetic images and prints");
+	println("the time of every stage as JSON.");
+	println("");
+	println("  -m  image sizes in megapixels (default 1,4,12,24,50)");
+	println("  -n  superpixel counts (default 800,5000)");
+	println("  -t  threads, 0 for all cores (default 0)");
+	println("  -i  iteration cap (default " << ITERATIONS << ")");
+	println("  -l  cluster in CIELAB");
+	println("  -f  fast mode, compared against exact mode for quality");
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<double> sizes = {1, 4, 12, 24, 50};
+	std::vector<double> counts = {800, 5000};
+	SlicParams params;
+	params.threads = 0;
+	bool fast = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:t:i:lfh")) != -1) {
+		switch (opt) {
+		case 'm': sizes = parseList(optarg); break;
+		case 'n': counts = parseList(optarg); break;
+		case 't': params.threads = atoi(optarg); break;
+		case 'i': params.iterations = atoi(optarg); break;
+		case 'l':
+			params.colorSpace = ColorSpace::LAB;
+			params.compactness = LAB_COMPACTNESS;
+			break;
+		case 'f': fast = true; break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	std::cout << "[" << std::endl;
+
+	bool first = true;
+	for (double mp : sizes) {
+		// 3:2 aspect ratio, like most camera sensors.
+		unsigned width = sqrt(mp * 1e6 * 1.5);
+		unsigned height = mp * 1e6 / width;
+
+		ImageReader reader;
+		ImageWriter writer;
+
+		std::vector<unsigned char> png;
+		writer.encodePng(png, syntheticImage(width, height));
+
+		for (double n : counts) {
+			params.superpixels = n;
+
+			// The memory of earlier runs is freed by now, and must not
+			// count towards this one.
+			resetPeakRss();
+
+			StageTimes times;
+			Image img(0, 0);
+			{
+				ScopedTimer timer(&times.decode);
+				reader.decodePng(png.data(), png.size(), img);
+			}
+
+			// Exact mode provides the reference segmentation that fast
+			// mode is scored against.
+			SlicResult reference;
+			StageTimes exactTimes;
+			if (fast) {
+				Slic exact(params);
+				exact.times = &exactTimes;
+				reference = exact.segment(img);
+				resetPeakRss();
+			}
+
+			SlicParams run = params;
+			if (fast)
+				run.fast();
+
+			Slic slic(run);
+			slic.times = &times;
+
+			SlicResult result = slic.segment(img);
+
+			{
+				ScopedTimer timer(&times.render);
+				img.superpixelate(result);
+			}
+
+			std::vector<unsigned char> out;
+			{
+				ScopedTimer timer(&times.encode);
+				writer.encodePng(out, img);
+			}
+
+			double megapixels = (double) width * height / 1e6;
+			double slicTime = times.total() - times.decode - times.render - times.encode;
+
+			std::cout << (first ? "" : ",\n")
+				<< "{\"width\": " << width
+				<< ", \"height\": " << height
+				<< ", \"megapixels\": " << megapixels
+				<< ", \"superpixels\": " << result.clusters.size()
+				<< ", \"threads\": " << slic.threads
+				<< ", \"iterations\": " << result.residuals.size()
+				<< ", \"stages\": ";
+			times.writeJson(std::cout);
+			std::cout << ", \"slic_mps\": " << megapixels / slicTime
+				<< ", \"pipeline_mps\": " << megapixels / times.total()
+				<< ", \"peak_rss_mb\": " << peakRssMb();
+
+			if (fast) {
+				std::cout << ", \"exact_slic_mps\": " << megapixels / exactTimes.total()
+					<< ", \"boundary_recall\": " << boundaryRecall(result.labels.data(),
+						reference.labels.data(), width, height)
+					<< ", \"undersegmentation_error\": " << undersegmentationError(
+						result.labels.data(), reference.labels.data(), width, height);
+			}
+
+			std::cout << "}";
+
+			first = false;
+		}
+	}
+
+	std::cout << std::endl << "]" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+#include "colorspace.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Reference white D65, in the scale of linear RGB in [0, 1].
+static const float XN = 0.950456f;
+static const float YN = 1.0f;
+static const float ZN = 1.088754f;
+
+// Below EPSILON the Lab transfer function is linear instead of a cube
+// root.
+static const float EPSILON = 216.0f / 24389.0f;
+static const float KAPPA = 24389.0f / 27.0f;
+
+// Pixels converted per chunk. Small enough for the chunk buffers to stay
+// in L1.
+static const size_t CHUNK = 256;
+
+static const int32_t CBRT_MAGIC = 0x2a508c2d;
+
+struct SrgbTable {
+	float linear[256];
+
+	SrgbTable()
+	{
+		for (int i = 0; i < 256; ++i) {
+			double c = i / 255.0;
+			linear[i] = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+		}
+	}
+};
+
+// Cube root for t in [EPSILON, 1]. Dividing the bit pattern of the float
+// by three (done in float, which SSE2 can do as well) gives an initial
+// guess within a few percent, which two Newton steps bring to float
+// precision.
+static inline float fastCbrt(float t)
+{
+	int32_t bits;
+	memcpy(&bits, &t, sizeof(bits));
+	bits = (int32_t) ((float) bits * (1.0f / 3.0f)) + CBRT_MAGIC;
+
+	float y;
+	memcpy(&y, &bits, sizeof(y));
+
+	y = (2.0f * y + t / (y * y)) * (1.0f / 3.0f);
+	y = (2.0f * y + t / (y * y)) * (1.0f / 3.0f);
+	return y;
+}
+
+static inline float labF(float t)
+{
+	float root = fastCbrt(t > EPSILON ? t : EPSILON);
+	float linear = (KAPPA * t + 16.0f) * (1.0f / 116.0f);
+	return t > EPSILON ? root : linear;
+}
+
+static void linearToLab(const float *r, const float *g, const float *b, size_t begin,
+		size_t n, float *L, float *A, float *B)
+{
+	for (size_t i = begin; i < n; ++i) {
+		float x = (0.412453f*r[i] + 0.357580f*g[i] + 0.180423f*b[i]) * (1.0f / XN);
+		float y = (0.212671f*r[i] + 0.715160f*g[i] + 0.072169f*b[i]) * (1.0f / YN);
+		float z = (0.019334f*r[i] + 0.119193f*g[i] + 0.950227f*b[i]) * (1.0f / ZN);
+
+		float fx = labF(x);
+		float fy = labF(y);
+		float fz = labF(z);
+
+		L[i] = 116.0f * fy - 16.0f;
+		A[i] = 500.0f * (fx - fy);
+		B[i] = 200.0f * (fy - fz);
+	}
+}
+
+#if defined(__x86_64__)
+
+static inline __m128 fastCbrtSse2(__m128 t)
+{
+	const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	__m128i bits = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(t)), third));
+	__m128 y = _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(CBRT_MAGIC)));
+
+	y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, y), _mm_div_ps(t, _mm_mul_ps(y, y))), third);
+	y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, y), _mm_div_ps(t, _mm_mul_ps(y, y))), third);
+	return y;
+}
+
+static inline __m128 labFSse2(__m128 t)
+{
+	const __m128 epsilon = _mm_set1_ps(EPSILON);
+
+	__m128 root = fastCbrtSse2(_mm_max_ps(t, epsilon));
+	__m128 linear = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(KAPPA), t), _mm_set1_ps(16.0f)),
+		_mm_set1_ps(1.0f / 116.0f));
+	__m128 mask = _mm_cmpgt_ps(t, epsilon);
+	return _mm_or_ps(_mm_and_ps(mask, root), _mm_andnot_ps(mask, linear));
+}
+
+// Returns the number of pixels converted, the rest is left to the scalar
+// loop.
+static size_t linearToLabSse2(const float *r, const float *g, const float *b, size_t n,
+		float *L, float *A, float *B)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 vr = _mm_loadu_ps(r + i);
+		__m128 vg = _mm_loadu_ps(g + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+
+		__m128 x = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.412453f), vr),
+			_mm_mul_ps(_mm_set1_ps(0.357580f), vg)), _mm_mul_ps(_mm_set1_ps(0.180423f), vb)),
+			_mm_set1_ps(1.0f / XN));
+		__m128 y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.212671f), vr),
+			_mm_mul_ps(_mm_set1_ps(0.715160f), vg)), _mm_mul_ps(_mm_set1_ps(0.072169f), vb)),
+			_mm_set1_ps(1.0f / YN));
+		__m128 z = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.019334f), vr),
+			_mm_mul_ps(_mm_set1_ps(0.119193f), vg)), _mm_mul_ps(_mm_set1_ps(0.950227f), vb)),
+			_mm_set1_ps(1.0f / ZN));
+
+		__m128 fx = labFSse2(x);
+		__m128 fy = labFSse2(y);
+		__m128 fz = labFSse2(z);
+
+		_mm_storeu_ps(L + i, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), fy), _mm_set1_ps(16.0f)));
+		_mm_storeu_ps(A + i, _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(fx, fy)));
+		_mm_storeu_ps(B + i, _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(fy, fz)));
+	}
+
+	return i;
+}
+
+#endif
+
+void rgbToLab(const unsigned char *rgb, size_t n, float *L, float *a, float *b)
+{
+	static const SrgbTable table;
+
+	float r[CHUNK], g[CHUNK], bl[CHUNK];
+
+	for (size_t begin = 0; begin < n; begin += CHUNK) {
+		size_t count = std::min(CHUNK, n - begin);
+		const unsigned char *px = rgb + 3 * begin;
+
+		for (size_t i = 0; i < count; ++i) {
+			r[i] = table.linear[px[3*i + 0]];
+			g[i] = table.linear[px[3*i + 1]];
+			bl[i] = table.linear[px[3*i + 2]];
+		}
+
+		size_t done = 0;
+#if defined(__x86_64__)
+		done = linearToLabSse2(r, g, bl, count, L + begin, a + begin, b + begin);
+#endif
+		linearToLab(r, g, bl, done, count, L + begin, a + begin, b + begin);
+	}
+}
+
+void imageToLab(const Image &img, float *L, float *a, float *b, unsigned threads,
+		ThreadPool *pool)
+{
+	const size_t width = img.width;
+
+	parallelFor(threads, img.height, [&](size_t begin, size_t end, unsigned) {
+		size_t offset = begin * width;
+		rgbToLab(img.data.data() + 3 * offset, (end - begin) * width,
+			L + offset, a + offset, b + offset);
+	}, pool);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+#include "image.h"
+
+// Converts <n> RGB pixels from sRGB to CIELAB (D65 white point) into the
+// planes <L>, <a> and <b>.
+//
+// sRGB linearization is a lookup in a 256 entry table, and the cube root
+// of the Lab transfer function uses a bit level initial guess refined by
+// two Newton steps. Pixels are converted in short chunks: one loop does
+// the table lookups, another the transform, which uses SSE2 on x86-64.
+void rgbToLab(const unsigned char *rgb, size_t n, float *L, float *a, float *b);
+
+// Converts the whole image, split into row bands over <threads>.
+void imageToLab(const Image &img, float *L, float *a, float *b, unsigned threads = 1,
+		ThreadPool *pool = nullptr);
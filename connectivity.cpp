@@ -0,0 +1,167 @@
+#include "connectivity.h"
+
+#include <algorithm>
+
+// Input labels are never below -1, which marks unassigned pixels.
+static const int32_t UNVISITED = -2;
+
+static inline void addBoundary(std::vector<BoundaryRun> &boundaries, int32_t a, int32_t b)
+{
+	uint64_t key = a < b ? ((uint64_t) a << 32) | (uint32_t) b : ((uint64_t) b << 32) | (uint32_t) a;
+
+	if (!boundaries.empty() && boundaries.back().key == key) {
+		++boundaries.back().length;
+		return;
+	}
+
+	BoundaryRun run = {key, 1};
+	boundaries.push_back(run);
+}
+
+// Adds the pairs of row <y> with its left and upper neighbors. Pairs
+// with the row above are added first, and in order, so that a straight
+// horizontal boundary becomes a single run.
+static void rowBoundaries(const int32_t *out, unsigned width, size_t y,
+		std::vector<BoundaryRun> &boundaries)
+{
+	const int32_t *row = &out[y * width];
+
+	if (y > 0) {
+		const int32_t *up = row - width;
+		for (size_t x = 0; x < width; ++x) {
+			if (row[x] != up[x] && row[x] >= 0 && up[x] >= 0)
+				addBoundary(boundaries, row[x], up[x]);
+		}
+	}
+
+	for (size_t x = 1; x < width; ++x) {
+		if (row[x] != row[x - 1] && row[x] >= 0 && row[x - 1] >= 0)
+			addBoundary(boundaries, row[x], row[x - 1]);
+	}
+}
+
+int32_t enforceConnectivity(const int32_t *labels, int32_t *out,
+		unsigned width, unsigned height, int minSize, bool relabel,
+		std::vector<int32_t> &queue, std::vector<BoundaryRun> *boundaries)
+{
+	const int dx[] = {-1, 0, 1, 0};
+	const int dy[] = {0, -1, 0, 1};
+	const size_t n = (size_t) width * height;
+
+	if (queue.size() < n)
+		queue.resize(n);
+
+	std::fill(out, out + n, UNVISITED);
+
+	int32_t label = 0;
+	int32_t *segment = queue.data();
+
+	for (size_t y = 0; y < height; ++y) {
+		for (size_t x = 0; x < width; ++x) {
+			size_t i = y * width + x;
+			if (out[i] != UNVISITED)
+				continue;
+
+			// Check 4-connected neighborhood to find the label
+			// (cluster) of an adjacent, already relabeled pixel.
+			int32_t neighborLabel = -1;
+			for (size_t d = 0; d < 4; ++d) {
+				int nx = x + dx[d];
+				int ny = y + dy[d];
+
+				if (nx < 0 || ny < 0 || nx >= (int) width || ny >= (int) height)
+					continue;
+
+				if (out[ny*width + nx] >= 0)
+					neighborLabel = out[ny*width + nx];
+			}
+
+			// The queue doubles as the list of pixels in the segment,
+			// as nothing is ever popped off its front.
+			const int32_t l = labels[i];
+			const int32_t newLabel = relabel ? label : l;
+			size_t count = 1;
+			segment[0] = i;
+			out[i] = newLabel;
+
+			for (size_t c = 0; c < count; ++c) {
+				int px = segment[c] % width;
+				int py = segment[c] / width;
+
+				for (size_t d = 0; d < 4; ++d) {
+					int nx = px + dx[d];
+					int ny = py + dy[d];
+
+					if (nx < 0 || ny < 0 || nx >= (int) width || ny >= (int) height)
+						continue;
+
+					size_t j = ny*width + nx;
+					if (out[j] == UNVISITED && labels[j] == l) {
+						out[j] = newLabel;
+						segment[count++] = j;
+					}
+				}
+			}
+
+			// Only the very first segment can lack a relabeled
+			// neighbor, in which case it is kept regardless of size.
+			if ((int) count <= minSize && neighborLabel >= 0) {
+				for (size_t c = 0; c < count; ++c) {
+					out[segment[c]] = neighborLabel;
+				}
+			} else {
+				++label;
+			}
+		}
+
+		// Every segment reaching into this row has been visited, so
+		// its labels no longer change.
+		if (boundaries)
+			rowBoundaries(out, width, y, *boundaries);
+	}
+
+	return label;
+}
+
+void buildRegionGraph(std::vector<BoundaryRun> &boundaries, size_t n, RegionGraph &graph)
+{
+	std::sort(boundaries.begin(), boundaries.end(),
+		[](const BoundaryRun &a, const BoundaryRun &b) { return a.key < b.key; });
+
+	// Merges the runs of every pair of labels into one edge.
+	size_t edges = 0;
+	for (size_t i = 0; i < boundaries.size(); ++i) {
+		if (edges && boundaries[edges - 1].key == boundaries[i].key) {
+			boundaries[edges - 1].length += boundaries[i].length;
+		} else {
+			boundaries[edges++] = boundaries[i];
+		}
+	}
+	boundaries.resize(edges);
+
+	graph.offsets.assign(n + 1, 0);
+	for (const BoundaryRun &run : boundaries) {
+		++graph.offsets[(run.key >> 32) + 1];
+		++graph.offsets[(uint32_t) run.key + 1];
+	}
+	for (size_t k = 0; k < n; ++k) {
+		graph.offsets[k + 1] += graph.offsets[k];
+	}
+
+	graph.neighbors.resize(2 * edges);
+	graph.lengths.resize(2 * edges);
+	graph.colorDiffs.clear();
+
+	// Edges are sorted by (a, b), so for every label the edges to
+	// smaller labels come before those to larger ones, and the lists
+	// come out sorted.
+	std::vector<uint32_t> next(graph.offsets.begin(), graph.offsets.end() - 1);
+	for (const BoundaryRun &run : boundaries) {
+		uint32_t a = run.key >> 32, b = (uint32_t) run.key;
+
+		graph.neighbors[next[a]] = b;
+		graph.lengths[next[a]++] = run.length;
+		graph.neighbors[next[b]] = a;
+		graph.lengths[next[b]++] = run.length;
+	}
+}
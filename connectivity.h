@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A run of 4-neighbor pixel pairs across the boundary between labels
+// a < b, packed as (a << 32) | b in <key>.
+struct BoundaryRun {
+	uint64_t key;
+	uint32_t length;
+};
+
+// Region adjacency graph in CSR form. The neighbors of label k are
+// neighbors[offsets[k]] up to neighbors[offsets[k + 1]], in ascending
+// order. Every edge is stored once for each of its two labels, with the
+// number of 4-neighbor pixel pairs on the shared boundary and the
+// distance between the mean colors of the two superpixels.
+struct RegionGraph {
+	std::vector<uint32_t> offsets;
+	std::vector<int32_t> neighbors;
+	std::vector<uint32_t> lengths;
+	std::vector<float> colorDiffs;
+};
+
+// Enforces connectivity of the label map <labels>. Every 4-connected
+// segment of equal labels gets its own label in <out>, numbered from 0 in
+// raster order of the first pixel of the segment. Segments of at most
+// <minSize> pixels are merged into an adjacent segment instead.
+//
+// If <relabel> is false, segments keep their input label, so labels stay
+// stable, but a label may cover several disconnected segments. Only the
+// small segments are merged away. The return value is then meaningless.
+//
+// Runs in linear time with one breadth-first pass over the image. <queue>
+// is a scratch buffer of pixel indices that is grown once and can be
+// reused between calls. Returns the number of labels in <out>.
+//
+// If <boundaries> is set, the boundaries between the output labels are
+// appended to it. Every row is scanned against the row above once its labels are
+// final, while both are still in cache.
+int32_t enforceConnectivity(const int32_t *labels, int32_t *out,
+		unsigned width, unsigned height, int minSize, bool relabel,
+		std::vector<int32_t> &queue, std::vector<BoundaryRun> *boundaries = nullptr);
+
+// Builds the adjacency of <n> labels from <boundaries>, which is sorted
+// in place. Leaves colorDiffs empty, as the mean colors are only known
+// once the statistics are gathered.
+void buildRegionGraph(std::vector<BoundaryRun> &boundaries, size_t n, RegionGraph &graph);
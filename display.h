@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+
+#include "image.h"
+
+// SDL front-end. Image::show() is defined here, so headless programs can
+// use the rest of the library without linking against SDL.
+
+void visualizePixels(std::vector<Pixel> &pixels, unsigned width, unsigned height);
+void visualizeAssignedCenters(std::vector<Pixel> &pixels, unsigned width, unsigned height);
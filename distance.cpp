@@ -0,0 +1,129 @@
+#include "distance.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+void assignRowScalar(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label)
+{
+	for (int x = x0; x < x0 + n; ++x) {
+		float d0 = c0[x] - center.c0;
+		float d1 = c1[x] - center.c1;
+		float d2 = c2[x] - center.c2;
+		float dx = (float) x - center.x;
+		float dc = d0*d0 + d1*d1 + d2*d2;
+		float d = dc + (dx*dx + dy2) * w;
+
+		if (d < dists[x]) {
+			dists[x] = d;
+			labels[x] = label;
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+// SSE2 is part of the x86-64 baseline, so this needs no target switch.
+void assignRowSse2(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label)
+{
+	const __m128 vc0 = _mm_set1_ps(center.c0);
+	const __m128 vc1 = _mm_set1_ps(center.c1);
+	const __m128 vc2 = _mm_set1_ps(center.c2);
+	const __m128 vcx = _mm_set1_ps(center.x);
+	const __m128 vdy2 = _mm_set1_ps(dy2);
+	const __m128 vw = _mm_set1_ps(w);
+	const __m128i vlabel = _mm_set1_epi32(label);
+	const __m128 step = _mm_set1_ps(4.0f);
+
+	__m128 vx = _mm_setr_ps(x0, x0 + 1, x0 + 2, x0 + 3);
+	int x = x0;
+
+	for (; x + 4 <= x0 + n; x += 4) {
+		__m128 d0 = _mm_sub_ps(_mm_loadu_ps(c0 + x), vc0);
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(c1 + x), vc1);
+		__m128 d2 = _mm_sub_ps(_mm_loadu_ps(c2 + x), vc2);
+		__m128 dx = _mm_sub_ps(vx, vcx);
+
+		__m128 dc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)),
+			_mm_mul_ps(d2, d2));
+		__m128 ds = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, dx), vdy2), vw);
+		__m128 d = _mm_add_ps(dc, ds);
+
+		__m128 old = _mm_loadu_ps(dists + x);
+		__m128 mask = _mm_cmplt_ps(d, old);
+		__m128i imask = _mm_castps_si128(mask);
+		__m128i oldl = _mm_loadu_si128((const __m128i *) (labels + x));
+
+		_mm_storeu_ps(dists + x, _mm_or_ps(_mm_and_ps(mask, d), _mm_andnot_ps(mask, old)));
+		_mm_storeu_si128((__m128i *) (labels + x),
+			_mm_or_si128(_mm_and_si128(imask, vlabel), _mm_andnot_si128(imask, oldl)));
+
+		vx = _mm_add_ps(vx, step);
+	}
+
+	assignRowScalar(c0, c1, c2, dists, labels, x, x0 + n - x, dy2, w, center, label);
+}
+
+__attribute__((target("avx2")))
+void assignRowAvx2(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label)
+{
+	const __m256 vc0 = _mm256_set1_ps(center.c0);
+	const __m256 vc1 = _mm256_set1_ps(center.c1);
+	const __m256 vc2 = _mm256_set1_ps(center.c2);
+	const __m256 vcx = _mm256_set1_ps(center.x);
+	const __m256 vdy2 = _mm256_set1_ps(dy2);
+	const __m256 vw = _mm256_set1_ps(w);
+	const __m256i vlabel = _mm256_set1_epi32(label);
+	const __m256 step = _mm256_set1_ps(8.0f);
+
+	__m256 vx = _mm256_setr_ps(x0, x0 + 1, x0 + 2, x0 + 3,
+		x0 + 4, x0 + 5, x0 + 6, x0 + 7);
+	int x = x0;
+
+	for (; x + 8 <= x0 + n; x += 8) {
+		__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(c0 + x), vc0);
+		__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(c1 + x), vc1);
+		__m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(c2 + x), vc2);
+		__m256 dx = _mm256_sub_ps(vx, vcx);
+
+		__m256 dc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0, d0), _mm256_mul_ps(d1, d1)),
+			_mm256_mul_ps(d2, d2));
+		__m256 ds = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), vdy2), vw);
+		__m256 d = _mm256_add_ps(dc, ds);
+
+		__m256 old = _mm256_loadu_ps(dists + x);
+		__m256 mask = _mm256_cmp_ps(d, old, _CMP_LT_OQ);
+		__m256i oldl = _mm256_loadu_si256((const __m256i *) (labels + x));
+
+		_mm256_storeu_ps(dists + x, _mm256_blendv_ps(old, d, mask));
+		_mm256_storeu_si256((__m256i *) (labels + x),
+			_mm256_blendv_epi8(oldl, vlabel, _mm256_castps_si256(mask)));
+
+		vx = _mm256_add_ps(vx, step);
+	}
+
+	assignRowSse2(c0, c1, c2, dists, labels, x, x0 + n - x, dy2, w, center, label);
+}
+
+#endif
+
+AssignRowFn assignRowKernel()
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return assignRowAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return assignRowSse2;
+#endif
+	return assignRowScalar;
+}
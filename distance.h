@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "slic.h"
+
+// Scans the pixels [x0, x0 + n) of one row of a center's window and
+// claims every pixel whose squared distance
+//
+//   D^2 = dc^2 + (dx^2 + dy^2) * w
+//
+// to the center is strictly below the one stored in <dists>. All
+// pointers point to the start of the row in their plane, <dy2> is the
+// squared vertical offset of the row to the center and <w> the spatial
+// weight. Every implementation evaluates the expression in the same
+// order, so they produce bit-identical planes.
+typedef void (*AssignRowFn)(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label);
+
+void assignRowScalar(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label);
+
+#if defined(__x86_64__)
+void assignRowSse2(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label);
+
+void assignRowAvx2(const float *c0, const float *c1, const float *c2,
+		float *dists, int32_t *labels,
+		int x0, int n, float dy2, float w,
+		const Center &center, int32_t label);
+#endif
+
+// Picks the widest implementation the running CPU supports.
+AssignRowFn assignRowKernel();
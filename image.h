@@ -9,7 +9,8 @@
 #include <map>
 #include <cfloat>
 
-#define ITERATIONS 10
+struct SlicResult;
+struct ThreadPool;
 
 struct Color {
 	double r;
@@ -83,25 +84,24 @@ struct Pixel {
 
 struct Image {
 	const char *fp;
+	// Packed 8 bit RGB, row by row.
 	std::vector<unsigned char> data;
 	unsigned width, height;
 
 	Image(const char *fp);
 	Image(unsigned width, unsigned height);
-	~Image();
 
 	void show() const;
-	void save(const char *fp) const;
+	bool save(const char *fp) const;
 	void setPixelColors(std::vector<Pixel> &pixels);
 	void setPixelsWhite(std::vector<Pixel> &pixels);
+	// Fills every superpixel with its mean color, see render.h.
+	void superpixelate(const SlicResult &result, unsigned threads = 1);
 	Color getPixelColor(int x, int y) const;
-
-	double gradient(int x, int y) const;
-	Pixel minGradNeigh(int x, int y, int width) const;
-
-	std::vector<Pixel> initCenters(int s) const;
-	void SLIC();
+	// Box filtered copy that is <factor> times smaller in each dimension,
+	// rounded up. Boxes on the right and bottom edge may be partial.
+	Image downscale(unsigned factor, unsigned threads = 1, ThreadPool *pool = nullptr) const;
+	// Same, into <small>, whose buffer is reused.
+	void downscale(unsigned factor, Image &small, unsigned threads = 1,
+			ThreadPool *pool = nullptr) const;
 };
-
-void visualizePixels(std::vector<Pixel> &pixels, unsigned width, unsigned height);
-void visualizeAssignedCenters(std::vector<Pixel> &pixels, unsigned width, unsigned height);
@@ -0,0 +1,288 @@
+#include "io.h"
+#include "util.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+static bool hasSuffix(const char *str, const char *suffix)
+{
+	size_t n = strlen(str), m = strlen(suffix);
+	return n >= m && strcmp(str + n - m, suffix) == 0;
+}
+
+void rgbaToRgb(unsigned char *data, size_t n)
+{
+	// Front to back, so every pixel is written at or behind where it
+	// was read from.
+	for (size_t i = 0; i < n; ++i) {
+		data[3*i + 0] = data[4*i + 0];
+		data[3*i + 1] = data[4*i + 1];
+		data[3*i + 2] = data[4*i + 2];
+	}
+}
+
+// Skips whitespace and comments between the fields of a PNM header.
+static void skipSpace(FILE *file)
+{
+	int c;
+	while ((c = fgetc(file)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(file)) != EOF && c != '\n')
+				;
+		} else if (!isspace(c)) {
+			ungetc(c, file);
+			return;
+		}
+	}
+}
+
+static bool readPpmHeader(FILE *file, unsigned &width, unsigned &height)
+{
+	unsigned maxval = 0;
+
+	skipSpace(file);
+	bool ok = fscanf(file, "%u", &width) == 1;
+	skipSpace(file);
+	ok = ok && fscanf(file, "%u", &height) == 1;
+	skipSpace(file);
+	ok = ok && fscanf(file, "%u", &maxval) == 1 && maxval == 255;
+
+	// A single whitespace character separates the header from the
+	// samples.
+	return ok && width && height && isspace(fgetc(file));
+}
+
+static bool readPamHeader(FILE *file, unsigned &width, unsigned &height, unsigned &channels)
+{
+	unsigned maxval = 0;
+	char token[32];
+
+	width = height = channels = 0;
+
+	for (;;) {
+		skipSpace(file);
+		if (fscanf(file, "%31s", token) != 1)
+			return false;
+
+		if (!strcmp(token, "ENDHDR"))
+			break;
+
+		bool ok = true;
+		if (!strcmp(token, "WIDTH")) {
+			ok = fscanf(file, "%u", &width) == 1;
+		} else if (!strcmp(token, "HEIGHT")) {
+			ok = fscanf(file, "%u", &height) == 1;
+		} else if (!strcmp(token, "DEPTH")) {
+			ok = fscanf(file, "%u", &channels) == 1;
+		} else if (!strcmp(token, "MAXVAL")) {
+			ok = fscanf(file, "%u", &maxval) == 1;
+		} else if (!strcmp(token, "TUPLTYPE")) {
+			ok = fscanf(file, "%31s", token) == 1;
+		}
+
+		if (!ok)
+			return false;
+	}
+
+	return fgetc(file) == '\n' && width && height && maxval == 255 &&
+		(channels == 3 || channels == 4);
+}
+
+// Whether <file> holds at least <size> more bytes.
+static bool hasBytes(FILE *file, uint64_t size)
+{
+	long offset = ftell(file);
+	if (offset < 0 || fseek(file, 0, SEEK_END))
+		return false;
+
+	long end = ftell(file);
+	return fseek(file, offset, SEEK_SET) == 0 && end >= offset && (uint64_t) (end - offset) >= size;
+}
+
+bool readPnmHeader(FILE *file, unsigned &width, unsigned &height, unsigned &channels)
+{
+	char magic[3] = {0};
+	if (fread(magic, 1, 2, file) != 2)
+		return false;
+
+	bool ok = false;
+	if (!strcmp(magic, "P6")) {
+		channels = 3;
+		ok = readPpmHeader(file, width, height);
+	} else if (!strcmp(magic, "P7")) {
+		ok = readPamHeader(file, width, height, channels);
+	}
+
+	// Before anyone sizes a buffer by the header.
+	return ok && hasBytes(file, (uint64_t) channels * width * height);
+}
+
+static bool readPnm(FILE *file, Image &img)
+{
+	unsigned width, height, channels;
+	if (!readPnmHeader(file, width, height, channels))
+		return false;
+
+	size_t n = (size_t) width * height;
+	img.data.resize(channels * n);
+	if (fread(img.data.data(), channels, n, file) != n)
+		return false;
+
+	if (channels == 4) {
+		rgbaToRgb(img.data.data(), n);
+		img.data.resize(3 * n);
+	}
+
+	img.width = width;
+	img.height = height;
+	return true;
+}
+
+static bool writePnm(const char *fp, const Image &img)
+{
+	FILE *file = fopen(fp, "wb");
+	if (!file) {
+		println("[writePnm error]: Could not open " << fp);
+		return false;
+	}
+
+	if (hasSuffix(fp, ".pam")) {
+		fprintf(file, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n",
+			img.width, img.height);
+	} else {
+		fprintf(file, "P6\n%u %u\n255\n", img.width, img.height);
+	}
+
+	bool ok = fwrite(img.data.data(), 1, img.data.size(), file) == img.data.size();
+	ok = fclose(file) == 0 && ok;
+
+	if (!ok)
+		println("[writePnm error]: Could not write " << fp);
+
+	return ok;
+}
+
+ImageReader::ImageReader()
+{
+	state.info_raw.colortype = LCT_RGB;
+	state.info_raw.bitdepth = 8;
+}
+
+bool ImageReader::decodePng(const unsigned char *in, size_t size, Image &img)
+{
+	unsigned char *buffer = nullptr;
+	unsigned width, height;
+
+	// lodepng allocates the pixels itself, with its default allocator,
+	// so they are copied into the buffer of <img> that is reused.
+	unsigned err = lodepng_decode(&buffer, &width, &height, &state, in, size);
+	if (err) {
+		println("[lodepng::decode error]: " << lodepng_error_text(err));
+		free(buffer);
+		return false;
+	}
+
+	img.width = width;
+	img.height = height;
+	img.data.assign(buffer, buffer + 3 * (size_t) width * height);
+	free(buffer);
+
+	return true;
+}
+
+bool ImageReader::read(const char *fp, Image &img)
+{
+	img.fp = fp;
+	img.width = img.height = 0;
+
+	FILE *in = fopen(fp, "rb");
+	if (!in) {
+		println("[ImageReader error]: Could not open " << fp);
+		img.data.clear();
+		return false;
+	}
+
+	int c0 = fgetc(in), c1 = fgetc(in);
+	rewind(in);
+
+	bool ok;
+	if (c0 == 'P' && (c1 == '6' || c1 == '7')) {
+		ok = readPnm(in, img);
+		if (!ok)
+			println("[ImageReader error]: " << fp << " is not a complete 8 bit binary PPM or PAM");
+	} else {
+		fseek(in, 0, SEEK_END);
+		long size = ftell(in);
+		rewind(in);
+
+		file.resize(size > 0 ? size : 0);
+		ok = size > 0 && fread(file.data(), 1, size, in) == (size_t) size &&
+			decodePng(file.data(), file.size(), img);
+		if (!ok && size <= 0)
+			println("[ImageReader error]: Could not read " << fp);
+	}
+
+	fclose(in);
+
+	if (!ok) {
+		img.width = img.height = 0;
+		img.data.clear();
+	}
+
+	return ok;
+}
+
+ImageWriter::ImageWriter(const PngSettings &settings)
+{
+	LodePNGEncoderSettings &encoder = state.encoder;
+
+	// The color type is known, so skip the scan of every pixel that
+	// looks for a smaller one.
+	encoder.auto_convert = 0;
+	state.info_raw.colortype = LCT_RGB;
+	state.info_raw.bitdepth = 8;
+	state.info_png.color.colortype = LCT_RGB;
+	state.info_png.color.bitdepth = 8;
+
+	encoder.filter_strategy = settings.filter && settings.level > 0 ? LFS_MINSUM : LFS_ZERO;
+
+	if (settings.level <= 0) {
+		encoder.zlibsettings.btype = 0;
+	} else if (settings.level == 1) {
+		encoder.zlibsettings.windowsize = 512;
+		encoder.zlibsettings.nicematch = 32;
+		encoder.zlibsettings.lazymatching = 0;
+	}
+}
+
+bool ImageWriter::encodePng(std::vector<unsigned char> &out, const Image &img)
+{
+	out.clear();
+
+	unsigned err = lodepng::encode(out, img.data.data(), img.width, img.height, state);
+	if (err) {
+		println("[lodepng::encode error]: " << lodepng_error_text(err));
+		return false;
+	}
+
+	return true;
+}
+
+bool ImageWriter::write(const char *fp, const Image &img)
+{
+	if (hasSuffix(fp, ".ppm") || hasSuffix(fp, ".pam"))
+		return writePnm(fp, img);
+
+	if (!encodePng(file, img))
+		return false;
+
+	unsigned err = lodepng::save_file(file, fp);
+	if (err) {
+		println("[lodepng::encode error]: " << lodepng_error_text(err));
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "vendor/lodepng.h"
+#include "image.h"
+
+// Effort of the PNG encoder.
+struct PngSettings {
+	// 0 stores the samples uncompressed, for intermediate files that are
+	// read back soon. 1 deflates with a small window and no lazy
+	// matching. 2 uses the lodepng defaults, which compress a little
+	// better at several times the cost.
+	int level = 1;
+	// Pick a filter per row by the minimum sum heuristic. Unfiltered rows
+	// are faster to write, but compress worse.
+	bool filter = true;
+};
+
+// Reads PNG, binary PPM (P6) and PAM (P7) files into the RGB buffer of
+// an Image, reusing its capacity. The format is told by the first bytes
+// of the file. The file buffer and decoder state are kept as well, so
+// one reader per thread decodes any number of files without growing.
+//
+// PNG is decoded straight to 8 bit RGB, so no alpha channel is expanded
+// and dropped again. Alpha in a PAM is skipped.
+struct ImageReader {
+	lodepng::State state;
+	std::vector<unsigned char> file;
+
+	ImageReader();
+
+	bool read(const char *fp, Image &img);
+	bool decodePng(const unsigned char *in, size_t size, Image &img);
+};
+
+// Writes Images as PNG, or as PPM or PAM if the name ends in .ppm or
+// .pam. Those are a short header in front of the raw samples, which
+// makes them the cheapest way to hand an image to another stage.
+struct ImageWriter {
+	lodepng::State state;
+	std::vector<unsigned char> file;
+
+	ImageWriter(const PngSettings &settings = PngSettings());
+
+	bool write(const char *fp, const Image &img);
+	bool encodePng(std::vector<unsigned char> &out, const Image &img);
+};
+
+// Parses the header of a PPM or PAM file with 8 bit samples, and leaves
+// <file> at the first sample. <channels> is 3 for RGB, 4 for RGB_ALPHA.
+// Fails on an empty image, or if the file is too short for the samples
+// the header announces.
+bool readPnmHeader(FILE *file, unsigned &width, unsigned &height, unsigned &channels);
+
+// Drops the alpha channel of <n> RGBA pixels in place.
+void rgbaToRgb(unsigned char *data, size_t n);
@@ -0,0 +1,359 @@
+#include "labelmap.h"
+#include "util.h"
+
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[4] = {'S', 'P', 'L', 'M'};
+static const uint32_t VERSION = 1;
+
+static_assert(sizeof(LabelMapHeader) == 32, "LabelMapHeader is written as is");
+static_assert(sizeof(Cluster) == 40, "Cluster is written as is");
+
+static size_t padded(size_t n)
+{
+	return (n + 7) & ~(size_t) 7;
+}
+
+// Appends the runs of <height> rows to <out>. <rows> receives their
+// offsets, counted from <offset>, the size of the runs before them.
+template <typename T>
+static bool encodeRuns(std::vector<unsigned char> &out, const int32_t *labels,
+		unsigned width, unsigned height, int64_t clusters, T none, uint64_t *rows,
+		uint64_t offset)
+{
+	std::vector<T> runs;
+
+	for (size_t y = 0; y < height; ++y) {
+		const int32_t *row = &labels[y * width];
+		rows[y] = offset + runs.size() * sizeof(T);
+
+		for (size_t x = 0; x < width; ) {
+			if (row[x] < -1 || row[x] >= clusters)
+				return false;
+
+			size_t end = x + 1;
+			while (end < width && row[end] == row[x])
+				++end;
+
+			runs.push_back(row[x] == -1 ? none : (T) row[x]);
+			runs.push_back(end - x);
+			x = end;
+		}
+	}
+	rows[height] = offset + runs.size() * sizeof(T);
+
+	size_t size = out.size();
+	out.resize(size + runs.size() * sizeof(T));
+	memcpy(&out[size], runs.data(), runs.size() * sizeof(T));
+	return true;
+}
+
+static bool encodeRuns(std::vector<unsigned char> &out, const LabelMapHeader &header,
+		const int32_t *labels, unsigned height, uint64_t *rows, uint64_t offset)
+{
+	if (header.labelBytes == 2) {
+		return encodeRuns(out, labels, header.width, height, header.clusters, LABEL_NONE16,
+			rows, offset);
+	}
+
+	return encodeRuns(out, labels, header.width, height, header.clusters, LABEL_NONE32,
+		rows, offset);
+}
+
+static LabelMapHeader makeHeader(unsigned width, unsigned height, uint32_t clusters)
+{
+	LabelMapHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.width = width;
+	header.height = height;
+	header.clusters = clusters;
+	// Labels go up to clusters - 1, and LABEL_NONE16 is taken.
+	header.labelBytes = clusters <= LABEL_NONE16 && width <= 0xFFFF ? 2 : 4;
+	header.statsOffset = 0;
+	return header;
+}
+
+static size_t tableSize(unsigned height)
+{
+	return sizeof(LabelMapHeader) + ((size_t) height + 1) * sizeof(uint64_t);
+}
+
+bool encodeLabelMap(std::vector<unsigned char> &out, const SlicResult &result)
+{
+	if (result.clusters.size() > INT32_MAX)
+		return false;
+
+	LabelMapHeader header = makeHeader(result.width, result.height, result.clusters.size());
+	std::vector<uint64_t> rows(result.height + 1);
+
+	out.resize(tableSize(result.height));
+	if (!encodeRuns(out, header, result.labels.data(), result.height, rows.data(), 0))
+		return false;
+
+	// The header and row table take a multiple of 8 bytes, so this pads
+	// the runs.
+	out.resize(padded(out.size()), 0);
+
+	header.statsOffset = out.size();
+	out.resize(out.size() + result.clusters.size() * sizeof(Cluster));
+
+	memcpy(&out[0], &header, sizeof(header));
+	memcpy(&out[sizeof(header)], rows.data(), rows.size() * sizeof(uint64_t));
+	if (!result.clusters.empty())
+		memcpy(&out[header.statsOffset], result.clusters.data(), result.clusters.size() * sizeof(Cluster));
+
+	return true;
+}
+
+bool saveLabelMap(const char *fp, const SlicResult &result)
+{
+	std::vector<unsigned char> out;
+	if (!encodeLabelMap(out, result)) {
+		println("[saveLabelMap error]: Labels out of range, not writing " << fp);
+		return false;
+	}
+
+	int fd = open(fp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		println("[saveLabelMap error]: Could not open " << fp);
+		return false;
+	}
+
+	size_t written = 0;
+	while (written < out.size()) {
+		ssize_t n = write(fd, &out[written], out.size() - written);
+		if (n <= 0)
+			break;
+		written += n;
+	}
+
+	close(fd);
+
+	if (written != out.size()) {
+		println("[saveLabelMap error]: Could not write " << fp);
+		return false;
+	}
+
+	return true;
+}
+
+LabelMap::LabelMap(const char *fp)
+{
+	int fd = open(fp, O_RDONLY);
+	if (fd < 0) {
+		println("[LabelMap error]: Could not open " << fp);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		size = st.st_size;
+		base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (base == MAP_FAILED)
+			base = nullptr;
+	}
+
+	close(fd);
+
+	if (!base || size < sizeof(LabelMapHeader)) {
+		println("[LabelMap error]: Could not map " << fp);
+		return;
+	}
+
+	const unsigned char *bytes = (const unsigned char *) base;
+	const LabelMapHeader *h = (const LabelMapHeader *) bytes;
+
+	size_t table = tableSize(h->height);
+	bool valid = memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0 && h->version == VERSION &&
+		(h->labelBytes == 2 || h->labelBytes == 4) && table <= size &&
+		h->statsOffset >= table && h->statsOffset % 8 == 0 && h->statsOffset <= size &&
+		h->clusters <= (size - h->statsOffset) / sizeof(Cluster);
+
+	if (valid) {
+		rows = (const uint64_t *) (bytes + sizeof(LabelMapHeader));
+		valid = rows[h->height] <= h->statsOffset - table;
+		for (unsigned y = 0; y < h->height && valid; ++y) {
+			valid = rows[y] <= rows[y + 1] && rows[y] % h->labelBytes == 0 &&
+				(rows[y + 1] - rows[y]) % (2 * h->labelBytes) == 0;
+		}
+	}
+
+	if (!valid) {
+		println("[LabelMap error]: " << fp << " is not a valid label map");
+		rows = nullptr;
+		return;
+	}
+
+	header = h;
+	runs = bytes + table;
+	clusters = (const Cluster *) (bytes + h->statsOffset);
+}
+
+LabelMap::~LabelMap()
+{
+	if (base)
+		munmap(base, size);
+}
+
+template <typename T>
+static bool decodeRow(const T *run, const T *end, int32_t *out, unsigned width,
+		uint32_t clusters, T none)
+{
+	size_t left = width;
+
+	for (; run < end; run += 2) {
+		if (run[1] > left || (run[0] >= clusters && run[0] != none))
+			return false;
+
+		std::fill(out, out + run[1], run[0] == none ? -1 : (int32_t) run[0]);
+		out += run[1];
+		left -= run[1];
+	}
+
+	return left == 0;
+}
+
+bool LabelMap::row(unsigned y, int32_t *out) const
+{
+	const unsigned char *begin = runs + rows[y];
+	const unsigned char *end = runs + rows[y + 1];
+
+	if (header->labelBytes == 2) {
+		return decodeRow((const uint16_t *) begin, (const uint16_t *) end, out, header->width,
+			header->clusters, LABEL_NONE16);
+	}
+
+	return decodeRow((const uint32_t *) begin, (const uint32_t *) end, out, header->width,
+		header->clusters, LABEL_NONE32);
+}
+
+bool LabelMap::labels(std::vector<int32_t> &out) const
+{
+	out.resize((size_t) header->width * header->height);
+
+	for (unsigned y = 0; y < header->height; ++y) {
+		if (!row(y, &out[(size_t) y * header->width]))
+			return false;
+	}
+
+	return true;
+}
+
+bool LabelMapWriter::open(const char *fp, unsigned width, unsigned height, uint32_t clusters)
+{
+	if (clusters > INT32_MAX)
+		return false;
+
+	this->fp = fp;
+	header = makeHeader(width, height, clusters);
+	rows.assign(height + 1, 0);
+	y = 0;
+	bytes = 0;
+
+	Accumulator empty = Accumulator();
+	empty.x0 = empty.y0 = UINT32_MAX;
+	sums.assign(clusters, empty);
+
+	file = fopen(fp, "wb");
+	if (!file) {
+		println("[LabelMapWriter error]: Could not open " << fp);
+		return false;
+	}
+
+	// The header and row table are only known at the end, keep room for
+	// them.
+	std::vector<unsigned char> table(tableSize(height), 0);
+	return fwrite(table.data(), 1, table.size(), file) == table.size();
+}
+
+bool LabelMapWriter::write(unsigned count, const int32_t *labels, const unsigned char *rgb)
+{
+	if (!file || count > header.height - y)
+		return false;
+
+	const unsigned width = header.width;
+
+	runs.clear();
+	if (!encodeRuns(runs, header, labels, count, &rows[y], bytes)) {
+		println("[LabelMapWriter error]: Labels out of range, not writing " << fp);
+		return false;
+	}
+
+	for (size_t i = 0; i < (size_t) count * width; ++i) {
+		int32_t l = labels[i];
+		if (l == -1)
+			continue;
+
+		uint32_t x = i % width, row = y + i / width;
+		const unsigned char *px = &rgb[3 * i];
+		Accumulator &acc = sums[l];
+		acc.c0 += px[0];
+		acc.c1 += px[1];
+		acc.c2 += px[2];
+		acc.x += x;
+		acc.y += row;
+		acc.count += 1;
+		acc.x0 = std::min(acc.x0, x);
+		acc.x1 = std::max(acc.x1, x);
+		acc.y0 = std::min(acc.y0, row);
+		acc.y1 = std::max(acc.y1, row);
+	}
+
+	y += count;
+	bytes += runs.size();
+
+	if (fwrite(runs.data(), 1, runs.size(), file) != runs.size()) {
+		println("[LabelMapWriter error]: Could not write " << fp);
+		return false;
+	}
+
+	return true;
+}
+
+bool LabelMapWriter::close()
+{
+	if (!file)
+		return false;
+
+	bool complete = y == header.height;
+	bool ok = complete;
+
+	std::vector<unsigned char> padding(padded(bytes) - bytes, 0);
+	ok = ok && fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+	header.statsOffset = tableSize(header.height) + padded(bytes);
+
+	std::vector<Cluster> clusters(sums.size());
+	for (size_t k = 0; k < sums.size(); ++k) {
+		clusters[k] = toCluster(sums[k]);
+	}
+
+	ok = ok && fwrite(clusters.data(), sizeof(Cluster), clusters.size(), file) == clusters.size();
+	ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(rows.data(), sizeof(uint64_t), rows.size(), file) == rows.size();
+
+	ok = fclose(file) == 0 && ok;
+	file = nullptr;
+
+	if (!complete) {
+		println("[LabelMapWriter error]: " << fp << " is missing rows");
+	} else if (!ok) {
+		println("[LabelMapWriter error]: Could not write " << fp);
+	}
+
+	return ok;
+}
+
+LabelMapWriter::~LabelMapWriter()
+{
+	if (file)
+		fclose(file);
+}
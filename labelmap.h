@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include "slic.h"
+
+// Binary label map (.splm): the labels of a segmentation together with
+// the statistics of every superpixel. All fields are little endian.
+//
+//   LabelMapHeader
+//   uint64_t rows[height + 1]   byte offset of each row in the run section
+//   runs                        per row, (label, length) pairs of
+//                               <labelBytes> each, padded to 8 bytes
+//   Cluster clusters[clusters]  at <statsOffset>
+//
+// Labels and run lengths are uint16 when both the number of clusters and
+// the width fit, uint32 otherwise. Label -1, which segmentations with
+// relabel = false leave on pixels no center claimed, is stored as the
+// largest value of the type, LABEL_NONE16 or LABEL_NONE32, and decoded
+// back to -1. Every other label is below <clusters>, and the runs of
+// every row add up to <width>. The row table allows decoding any row on
+// its own.
+static const uint16_t LABEL_NONE16 = 0xFFFF;
+static const uint32_t LABEL_NONE32 = 0xFFFFFFFF;
+
+struct LabelMapHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t clusters;
+	uint32_t labelBytes;
+	uint64_t statsOffset;
+};
+
+// Encodes <result> into <out>, which is built in memory so that the file
+// can be written with a single write(). Fails if a label is neither -1 nor
+// the index of a cluster.
+bool encodeLabelMap(std::vector<unsigned char> &out, const SlicResult &result);
+bool saveLabelMap(const char *fp, const SlicResult &result);
+
+// Writes a label map a few rows at a time, for images whose labels are
+// never all in memory. Only the row table and the statistics are kept
+// until close(), which fills in the header and row table at the start of
+// the file.
+struct LabelMapWriter {
+	const char *fp = nullptr;
+	FILE *file = nullptr;
+	LabelMapHeader header;
+	std::vector<uint64_t> rows;
+	std::vector<Accumulator> sums;
+	std::vector<unsigned char> runs;
+	// Rows and bytes of runs written so far.
+	unsigned y = 0;
+	uint64_t bytes = 0;
+
+	LabelMapWriter() = default;
+	~LabelMapWriter();
+	LabelMapWriter(const LabelMapWriter &) = delete;
+	LabelMapWriter &operator=(const LabelMapWriter &) = delete;
+
+	// Labels must be -1 or below <clusters>.
+	bool open(const char *fp, unsigned width, unsigned height, uint32_t clusters);
+	// Appends the next <count> rows, and adds the RGB pixels <rgb> they
+	// were segmented from to the statistics.
+	bool write(unsigned count, const int32_t *labels, const unsigned char *rgb);
+	bool close();
+};
+
+// Read only view of a label map file through mmap. Nothing is copied:
+// the header, row table, runs and cluster table point into the mapping.
+// On errors, <header> is null.
+struct LabelMap {
+	const LabelMapHeader *header = nullptr;
+	const uint64_t *rows = nullptr;
+	const unsigned char *runs = nullptr;
+	const Cluster *clusters = nullptr;
+
+	LabelMap(const char *fp);
+	~LabelMap();
+	LabelMap(const LabelMap &) = delete;
+	LabelMap &operator=(const LabelMap &) = delete;
+
+	// Expands row <y> into <width> labels. Fails if the runs of the row
+	// do not add up to the width, or hold a label out of range.
+	bool row(unsigned y, int32_t *out) const;
+	bool labels(std::vector<int32_t> &out) const;
+
+	void *base = nullptr;
+	size_t size = 0;
+};
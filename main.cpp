@@ -1,13 +1,125 @@
 #include <iostream>
 #include <tuple>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "vendor/lodepng.h"
 #include "image.h"
+#include "slic.h"
+#include "batch.h"
+#include "util.h"
+
+static void usage(const char *prog)
+{
+	println("usage: " << prog << " [options] [image.png | directory]...");
+	println("");
+	println("Without inputs, segments img/pingpong.png and shows the result.");
+	println("Without -o, directories are listed without the outputs of earlier runs.");
+	println("");
+	println("  -o DIR  write results to DIR instead of next to the inputs");
+	println("  -b      write binary label maps (.splm) instead of images");
+	println("  -p      write PPM instead of PNG");
+	println("  -r      also write <name>_contours and <name>_labels for review");
+	println("  -z N    PNG compression: 0 stored, 1 fast, 2 best (default 1)");
+	println("  -V      inputs are video frames: warm start each from the last");
+	println("  -R N    iterations per frame with -V, and at full size with -f (default 2)");
+	println("  -T N    segment PPM/PAM inputs in bands of N rows into label maps");
+	println("  -n N    number of superpixels (default 800)");
+	println("  -s S    grid step, overrides -n");
+	println("  -c C    compactness (default " << COMPACTNESS << ", " << LAB_COMPACTNESS << " with -l)");
+	println("  -i N    iteration cap (default " << ITERATIONS << ")");
+	println("  -e E    stop once the residual error drops below E");
+	println("  -l      measure color distance in CIELAB instead of RGB");
+	println("  -f      fast mode for previews: coarse to fine, subsampled updates");
+	println("  -t N    threads per image, 0 for all cores (default 1)");
+	println("  -j N    images segmented in parallel (default 1)");
+	println("  -d N    decoder threads (default 1)");
+	println("  -w N    encoder threads (default 1)");
+	println("  -v      verbose");
+}
 
 int main(int argc, char *argv[])
 {
-	Image img = Image("img/pingpong.png");
-	img.SLIC();
+	BatchOptions options;
+	SlicParams &params = options.params;
+
+	// The demo runs on all cores unless told otherwise.
+	bool threads = false;
+	bool compactness = false;
+	// Applied after -f, which sets its own.
+	int refine = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:bprz:VR:T:n:s:c:i:e:lft:j:d:w:vh")) != -1) {
+		switch (opt) {
+		case 'o': options.outputDir = optarg; break;
+		case 'b': options.labelMaps = true; break;
+		case 'p': options.ppm = true; break;
+		case 'r': options.review = true; break;
+		case 'z': options.png.level = atoi(optarg); break;
+		case 'V': options.temporal = true; break;
+		case 'R': refine = atoi(optarg); break;
+		case 'T': options.bandRows = atoi(optarg); break;
+		case 'n': params.superpixels = atoi(optarg); break;
+		case 's': params.step = atoi(optarg); break;
+		case 'c': params.compactness = atof(optarg); compactness = true; break;
+		case 'i': params.iterations = atoi(optarg); break;
+		case 'e': params.threshold = atof(optarg); break;
+		case 'l': params.colorSpace = ColorSpace::LAB; break;
+		case 'f': params.fast(); break;
+		case 't': params.threads = atoi(optarg); threads = true; break;
+		case 'j': options.workers = atoi(optarg); break;
+		case 'd': options.decoders = atoi(optarg); break;
+		case 'w': options.encoders = atoi(optarg); break;
+		case 'v': options.verbose = true; break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (refine > 0)
+		params.refine = refine;
+
+	if (params.colorSpace == ColorSpace::LAB && !compactness)
+		params.compactness = LAB_COMPACTNESS;
+
+	if (optind == argc) {
+		Image img("img/pingpong.png");
+		if (img.data.empty())
+			return 1;
+
+		if (!threads)
+			params.threads = 0;
+		params.verbose = true;
+
+		Slic slic(params);
+		SlicResult result = slic.segment(img);
+
+		img.superpixelate(result, slic.threads);
+		img.show();
+
+		return 0;
+	}
+
+	std::vector<std::string> inputs;
+	for (int i = optind; i < argc; ++i) {
+		struct stat st;
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			std::vector<std::string> files = listImages(argv[i], options.outputDir.empty());
+			inputs.insert(inputs.end(), files.begin(), files.end());
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	int failures = runBatch(inputs, options);
+	if (failures)
+		println(failures << "/" << inputs.size() << " images failed");
 
-	return 0;
+	return failures ? 1 : 0;
 }
@@ -0,0 +1,110 @@
+#include "metrics.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+static std::vector<uint8_t> boundaries(const int32_t *labels, unsigned width, unsigned height)
+{
+	std::vector<uint8_t> edge((size_t) width * height, 0);
+
+	for (size_t y = 0; y < height; ++y) {
+		for (size_t x = 0; x < width; ++x) {
+			size_t i = y * width + x;
+			edge[i] = (x + 1 < width && labels[i] != labels[i + 1]) ||
+				(y + 1 < height && labels[i] != labels[i + width]);
+		}
+	}
+
+	return edge;
+}
+
+// Marks every pixel within <r> pixels of a set one along a line of <n>
+// values <stride> apart. Counts set values with a sliding window.
+static void dilateLine(const uint8_t *in, uint8_t *out, size_t n, size_t stride, int r)
+{
+	int count = 0;
+	for (size_t i = 0; i < n && i < (size_t) r; ++i) {
+		count += in[i * stride];
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		if (i + r < n)
+			count += in[(i + r) * stride];
+		if (i > (size_t) r)
+			count -= in[(i - r - 1) * stride];
+
+		out[i * stride] = count > 0;
+	}
+}
+
+float boundaryRecall(const int32_t *labels, const int32_t *reference,
+		unsigned width, unsigned height, int tolerance)
+{
+	std::vector<uint8_t> edge = boundaries(labels, width, height);
+	std::vector<uint8_t> near(edge.size());
+
+	// Separable square dilation: rows first, then columns.
+	for (size_t y = 0; y < height; ++y) {
+		dilateLine(&edge[y * width], &near[y * width], width, 1, tolerance);
+	}
+	for (size_t x = 0; x < width; ++x) {
+		dilateLine(&near[x], &edge[x], height, width, tolerance);
+	}
+
+	std::vector<uint8_t> truth = boundaries(reference, width, height);
+
+	size_t total = 0, hits = 0;
+	for (size_t i = 0; i < truth.size(); ++i) {
+		total += truth[i];
+		hits += truth[i] & edge[i];
+	}
+
+	return total ? (float) hits / total : 1.0f;
+}
+
+float undersegmentationError(const int32_t *labels, const int32_t *reference,
+		unsigned width, unsigned height)
+{
+	const size_t n = (size_t) width * height;
+	if (!n)
+		return 0.0f;
+
+	// Overlap of every (reference segment, superpixel) pair. Runs of
+	// equal pairs along a row are counted before sorting, which keeps
+	// the list short.
+	std::vector<std::pair<uint64_t, uint32_t>> runs;
+	std::vector<size_t> sizes;
+
+	for (size_t y = 0; y < height; ++y) {
+		size_t row = y * width;
+		for (size_t x = 0; x < width; ) {
+			int32_t r = reference[row + x], l = labels[row + x];
+			size_t end = x + 1;
+			while (end < width && reference[row + end] == r && labels[row + end] == l)
+				++end;
+
+			runs.push_back(std::make_pair(((uint64_t) r << 32) | (uint32_t) l, end - x));
+			if ((size_t) l >= sizes.size())
+				sizes.resize(l + 1, 0);
+			sizes[l] += end - x;
+			x = end;
+		}
+	}
+
+	std::sort(runs.begin(), runs.end());
+
+	size_t error = 0;
+	for (size_t i = 0; i < runs.size(); ) {
+		size_t overlap = 0, j = i;
+		for (; j < runs.size() && runs[j].first == runs[i].first; ++j) {
+			overlap += runs[j].second;
+		}
+
+		uint32_t l = (uint32_t) runs[i].first;
+		error += std::min(overlap, sizes[l] - overlap);
+		i = j;
+	}
+
+	return (float) error / n;
+}
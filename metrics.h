@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Quality of a segmentation measured against a reference segmentation of
+// the same image, typically the output of exact mode when judging an
+// approximation. Label maps are indexed by y*width + x and hold no
+// negative labels.
+
+// Fraction of the reference boundary pixels that have a boundary pixel of
+// <labels> within <tolerance> pixels in x and y. A pixel is on a boundary
+// if its right or lower neighbor has another label. 1 is perfect.
+float boundaryRecall(const int32_t *labels, const int32_t *reference,
+		unsigned width, unsigned height, int tolerance = 2);
+
+// Undersegmentation error: every superpixel overlapping a reference
+// segment counts the smaller of its parts inside and outside of it, and
+// the total is divided by the number of pixels. 0 is perfect.
+float undersegmentationError(const int32_t *labels, const int32_t *reference,
+		unsigned width, unsigned height);
@@ -0,0 +1,70 @@
+#include "parallel.h"
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	start.notify_all();
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(unsigned threads, size_t n, Task task, void *context)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// New workers start out having seen the current job, so they wait
+	// for the one posted below.
+	while (workers.size() + 1 < threads) {
+		workers.push_back(std::thread(&ThreadPool::work, this, workers.size() + 1, generation));
+	}
+
+	this->task = task;
+	this->context = context;
+	this->n = n;
+	this->threads = threads;
+	pending = threads - 1;
+	++generation;
+
+	lock.unlock();
+	start.notify_all();
+
+	task(context, 0, n / threads, 0);
+
+	lock.lock();
+	done.wait(lock, [&] { return pending == 0; });
+}
+
+void ThreadPool::work(unsigned t, uint64_t seen)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		start.wait(lock, [&] { return stop || generation != seen; });
+		if (stop)
+			return;
+
+		seen = generation;
+
+		// Workers beyond the thread count of this job sit it out.
+		// run() does not return before the others are done, so they
+		// cannot miss a job they take part in.
+		if (t >= threads)
+			continue;
+
+		Task task = this->task;
+		void *context = this->context;
+		size_t begin = n * t / threads, end = n * (t + 1) / threads;
+
+		lock.unlock();
+		task(context, begin, end, t);
+		lock.lock();
+
+		if (--pending == 0)
+			done.notify_one();
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Number of worker threads to use when the caller asks for 0 (= all).
+inline unsigned resolveThreads(unsigned threads)
+{
+	if (threads)
+		return threads;
+
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+// Worker threads that are started once and then wait for chunks of
+// parallelFor(). Worker t - 1 always runs chunk t, and the calling thread
+// chunk 0. Workers are added on demand, so a pool grows to the largest
+// thread count it was asked for. A pool runs one parallelFor() at a time.
+struct ThreadPool {
+	typedef void (*Task)(void *context, size_t begin, size_t end, unsigned t);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start, done;
+
+	// The current job. <generation> counts jobs, so that workers can
+	// tell a new one from the one they just finished.
+	Task task = nullptr;
+	void *context = nullptr;
+	size_t n = 0;
+	unsigned threads = 0;
+	unsigned pending = 0;
+	uint64_t generation = 0;
+	bool stop = false;
+
+	ThreadPool() = default;
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	~ThreadPool();
+
+	// Splits [0, n) as parallelFor() does and returns once every chunk
+	// has run.
+	void run(unsigned threads, size_t n, Task task, void *context);
+	void work(unsigned t, uint64_t seen);
+};
+
+// Splits [0, n) into <threads> contiguous chunks and runs fn(begin, end, t)
+// for chunk t on its own thread, with the calling thread taking chunk 0.
+// The chunk boundaries only depend on <n> and <threads>.
+//
+// With a <pool>, the chunks run on its workers. Otherwise the threads are
+// started for this call only, which is fine for a single pass over an
+// image, but not for the many passes of a segmentation.
+template <typename F>
+void parallelFor(unsigned threads, size_t n, F fn, ThreadPool *pool = nullptr)
+{
+	if (threads > n)
+		threads = n ? n : 1;
+
+	if (threads <= 1) {
+		fn((size_t) 0, n, 0u);
+		return;
+	}
+
+	if (pool) {
+		pool->run(threads, n, [](void *context, size_t begin, size_t end, unsigned t) {
+			(*static_cast<F *>(context))(begin, end, t);
+		}, &fn);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < threads; ++t) {
+		workers.push_back(std::thread(fn, n * t / threads, n * (t + 1) / threads, t));
+	}
+
+	fn((size_t) 0, n / threads, 0u);
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
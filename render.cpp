@@ -0,0 +1,105 @@
+#include "render.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+static inline unsigned char toByte(float v)
+{
+	return std::min(std::max((int) lrintf(v), 0), 255);
+}
+
+void meanPalette(const SlicResult &result, std::vector<unsigned char> &palette)
+{
+	palette.resize(3 * result.clusters.size());
+
+	for (size_t k = 0; k < result.clusters.size(); ++k) {
+		const Cluster &cluster = result.clusters[k];
+		palette[3*k + 0] = toByte(cluster.r);
+		palette[3*k + 1] = toByte(cluster.g);
+		palette[3*k + 2] = toByte(cluster.b);
+	}
+}
+
+void falseColorPalette(size_t n, std::vector<unsigned char> &palette)
+{
+	palette.resize(3 * n);
+
+	for (size_t k = 0; k < n; ++k) {
+		// Integer hash, so that neighboring labels get unrelated
+		// colors.
+		uint32_t h = k * 0x9E3779B1u;
+		h ^= h >> 15;
+		h *= 0x85EBCA77u;
+		h ^= h >> 13;
+
+		// Keep every channel away from black, which would be hard to
+		// tell apart.
+		palette[3*k + 0] = 64 + (h & 0xFF) % 192;
+		palette[3*k + 1] = 64 + ((h >> 8) & 0xFF) % 192;
+		palette[3*k + 2] = 64 + ((h >> 16) & 0xFF) % 192;
+	}
+}
+
+void fillLabels(const int32_t *labels, size_t n, const std::vector<unsigned char> &palette,
+		unsigned char *out)
+{
+	static const unsigned char black[3] = {0, 0, 0};
+	const unsigned char *colors = palette.data();
+
+	for (size_t i = 0; i < n; ++i, out += 3) {
+		memcpy(out, labels[i] < 0 ? black : &colors[3 * labels[i]], 3);
+	}
+}
+
+void renderFill(const SlicResult &result, const std::vector<unsigned char> &palette,
+		Image &out, unsigned threads)
+{
+	const size_t width = result.width;
+
+	out.width = result.width;
+	out.height = result.height;
+	out.data.resize(3 * width * result.height);
+
+	parallelFor(threads, result.height, [&](size_t begin, size_t end, unsigned) {
+		fillLabels(&result.labels[begin * width], (end - begin) * width, palette,
+			&out.data[3 * begin * width]);
+	});
+}
+
+void renderContours(const Image &img, const SlicResult &result, const unsigned char color[3],
+		Image &out, unsigned threads)
+{
+	const size_t width = result.width;
+	const size_t height = result.height;
+
+	const bool copy = &out != &img;
+
+	if (copy) {
+		out.width = img.width;
+		out.height = img.height;
+		out.data.resize(img.data.size());
+	}
+
+	parallelFor(threads, height, [&](size_t begin, size_t end, unsigned) {
+		for (size_t y = begin; y < end; ++y) {
+			const int32_t *row = &result.labels[y * width];
+			// The last row has no lower neighbor, compare it to
+			// itself.
+			const int32_t *down = y + 1 < height ? row + width : row;
+			unsigned char *px = &out.data[3 * y * width];
+
+			if (copy)
+				memcpy(px, &img.data[3 * y * width], 3 * width);
+
+			for (size_t x = 0; x + 1 < width; ++x) {
+				if (row[x] != row[x + 1] || row[x] != down[x])
+					memcpy(&px[3 * x], color, 3);
+			}
+
+			if (width && row[width - 1] != down[width - 1])
+				memcpy(&px[3 * (width - 1)], color, 3);
+		}
+	});
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "image.h"
+#include "slic.h"
+
+// Renders of a label plane. Every output is a single pass over the rows,
+// split into bands over <threads>. Colors come from a palette of 3 bytes
+// per label, built once per image, so the per pixel work is a lookup and
+// a copy.
+
+// Mean color of every cluster, rounded.
+void meanPalette(const SlicResult &result, std::vector<unsigned char> &palette);
+
+// A color for each of <n> labels that only depends on the label, so a
+// superpixel keeps its color as long as it keeps its ID, e.g. across the
+// frames of a video.
+void falseColorPalette(size_t n, std::vector<unsigned char> &palette);
+
+// Writes the palette color of each of the <n> <labels> to <out>, as RGB.
+// Label -1, which no center claimed, is black.
+void fillLabels(const int32_t *labels, size_t n, const std::vector<unsigned char> &palette,
+		unsigned char *out);
+
+// Fills every pixel of <out> with the palette color of its label, see
+// fillLabels(). <out> is resized to the label plane.
+void renderFill(const SlicResult &result, const std::vector<unsigned char> &palette,
+		Image &out, unsigned threads = 1);
+
+// Copies <img> into <out> and draws the boundaries between superpixels on
+// top in <color>, as in the figures of the SLIC paper. A pixel is on a
+// boundary if its right or lower neighbor has another label, which gives
+// lines one pixel wide. <out> may be <img>.
+void renderContours(const Image &img, const SlicResult &result, const unsigned char color[3],
+		Image &out, unsigned threads = 1);
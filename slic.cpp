@@ -0,0 +1,660 @@
+#include "slic.h"
+#include "distance.h"
+#include "connectivity.h"
+#include "colorspace.h"
+#include "parallel.h"
+#include "util.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// Color sums are kept in 16.16 fixed point. Integer sums are exact, so
+// partial sums of any split of the image reduce to the same value.
+static const float FIXED_ONE = 65536.0f;
+
+int SlicParams::gridStep(unsigned width, unsigned height) const
+{
+	if (step > 0)
+		return step;
+
+	double n_sp = superpixels;
+	double n_tp = (double) width * height;
+	return std::max((int) sqrt(n_tp / n_sp), 1);
+}
+
+void SlicParams::fast()
+{
+	subsample = 2;
+	downscale = 2;
+	refine = 1;
+}
+
+template <typename T>
+static size_t bytes(const std::vector<T> &v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+size_t SlicWorkspace::capacity() const
+{
+	return bytes(c0) + bytes(c1) + bytes(c2) + bytes(labels) + bytes(dists) +
+		bytes(gradients) + bytes(centers) + bytes(partials) + bytes(moves) +
+		bytes(previous) + bytes(dirty) + bytes(changed) + bytes(active) + bytes(queue) +
+		bytes(boundaries) + bytes(small.data);
+}
+
+Slic::Slic(const SlicParams &params, SlicWorkspace *workspace)
+	: params(params), threads(resolveThreads(params.threads)), width(0), height(0),
+	workspace(workspace)
+{
+	if (!workspace) {
+		own.reset(new SlicWorkspace());
+		this->workspace = own.get();
+	}
+}
+
+SlicResult Slic::segment(const Image &img)
+{
+	SlicResult result;
+	segment(img, result);
+
+	return result;
+}
+
+void Slic::segment(const Image &img, SlicResult &result)
+{
+	result.residuals.clear();
+
+	// E.g. a file that failed to decode. There is nothing to seed, and
+	// the minimum segment size would divide by zero centers.
+	if (!img.width || !img.height) {
+		width = height = 0;
+		result.width = result.height = 0;
+		result.labels.clear();
+		result.clusters.clear();
+		result.graph = RegionGraph();
+		return;
+	}
+
+	int s = params.gridStep(img.width, img.height);
+
+	if (params.downscale > 1) {
+		seedCoarse(img, s, result.residuals);
+
+		{
+			ScopedTimer timer(times ? &times->convert : nullptr);
+			load(img);
+		}
+
+		iterate(s, params.refine, result.residuals);
+	} else {
+		{
+			ScopedTimer timer(times ? &times->convert : nullptr);
+			load(img);
+		}
+
+		{
+			ScopedTimer timer(times ? &times->seeding : nullptr);
+			seed(s);
+		}
+
+		iterate(s, params.iterations, result.residuals);
+	}
+
+	finish(img, result);
+}
+
+void Slic::finish(const Image &img, SlicResult &result)
+{
+	SlicWorkspace &ws = *workspace;
+
+	// Merge segments smaller than a quarter of the expected superpixel
+	// size into their neighbors.
+	const int minSize = ((size_t) width * height / ws.centers.size()) >> 2;
+
+	result.width = width;
+	result.height = height;
+	result.labels.resize((size_t) width * height);
+
+	int32_t n;
+	{
+		ScopedTimer timer(times ? &times->connectivity : nullptr);
+		ws.boundaries.clear();
+		n = enforceConnectivity(ws.labels.data(), result.labels.data(),
+			width, height, minSize, params.relabel, ws.queue,
+			params.adjacency ? &ws.boundaries : nullptr);
+	}
+
+	size_t clusters = params.relabel ? n : ws.centers.size();
+	{
+		ScopedTimer timer(times ? &times->statistics : nullptr);
+		gatherClusters(img, result, clusters);
+	}
+
+	if (params.adjacency) {
+		ScopedTimer timer(times ? &times->connectivity : nullptr);
+		buildRegionGraph(ws.boundaries, clusters, result.graph);
+
+		RegionGraph &graph = result.graph;
+		graph.colorDiffs.resize(graph.neighbors.size());
+
+		for (size_t k = 0; k < clusters; ++k) {
+			const Cluster &a = result.clusters[k];
+			for (uint32_t e = graph.offsets[k]; e < graph.offsets[k + 1]; ++e) {
+				const Cluster &b = result.clusters[graph.neighbors[e]];
+				float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+				graph.colorDiffs[e] = sqrtf(dr*dr + dg*dg + db*db);
+			}
+		}
+	} else {
+		result.graph = RegionGraph();
+	}
+}
+
+void Slic::iterate(int s, int iterations, std::vector<float> &residuals)
+{
+	for (int i = 0; i < iterations; ++i) {
+		if (times)
+			times->assignment.push_back(0.0);
+
+		{
+			ScopedTimer timer(times ? &times->assignment.back() : nullptr);
+			assign(s);
+		}
+
+		float residual;
+		{
+			ScopedTimer timer(times ? &times->update : nullptr);
+			residual = update() * pixelSize;
+		}
+
+		residuals.push_back(residual);
+
+		if (params.verbose)
+			println("Iteration " << i+1 << "/" << iterations << ", E = " << residual);
+
+		if (residual < params.threshold)
+			break;
+	}
+}
+
+void Slic::load(const Image &img, bool keep)
+{
+	SlicWorkspace &ws = *workspace;
+	keep = keep && img.width == width && img.height == height;
+	width = img.width;
+	height = img.height;
+
+	size_t n = (size_t) width * height;
+
+	ws.c0.resize(n);
+	ws.c1.resize(n);
+	ws.c2.resize(n);
+	if (!keep) {
+		ws.labels.assign(n, -1);
+		ws.dists.assign(n, FLT_MAX);
+		ws.previous.clear();
+	}
+
+	if (params.colorSpace == ColorSpace::LAB) {
+		imageToLab(img, ws.c0.data(), ws.c1.data(), ws.c2.data(), threads, &ws.pool);
+		return;
+	}
+
+	parallelFor(threads, n, [&](size_t begin, size_t end, unsigned) {
+		for (size_t i = begin; i < end; ++i) {
+			ws.c0[i] = img.data[3*i + 0];
+			ws.c1[i] = img.data[3*i + 1];
+			ws.c2[i] = img.data[3*i + 2];
+		}
+	}, &ws.pool);
+}
+
+// Index of the lowest gradient in the <window> x <window> neighborhood
+// of (x, y), clipped to the plane. Ties go to the first in raster order.
+static size_t lowestGradient(const std::vector<float> &grad, unsigned width, unsigned height,
+		int x, int y, int window)
+{
+	int half = window / 2;
+	size_t lowest = (size_t) y * width + x;
+	float min = FLT_MAX;
+
+	for (int i = std::max(y - half, 0); i <= std::min(y + half, (int) height - 1); ++i) {
+		for (int j = std::max(x - half, 0); j <= std::min(x + half, (int) width - 1); ++j) {
+			size_t k = (size_t) i * width + j;
+			if (grad[k] < min) {
+				min = grad[k];
+				lowest = k;
+			}
+		}
+	}
+
+	return lowest;
+}
+
+// The center that starts on pixel i of the planes.
+static Center centerAt(const SlicWorkspace &ws, size_t i, unsigned width)
+{
+	Center center;
+	center.c0 = ws.c0[i];
+	center.c1 = ws.c1[i];
+	center.c2 = ws.c2[i];
+	center.x = i % width;
+	center.y = i / width;
+	return center;
+}
+
+void Slic::seed(int s)
+{
+	SlicWorkspace &ws = *workspace;
+	ws.centers.clear();
+	gradientMap();
+
+	for (unsigned y = 0; y < height; y += s) {
+		for (unsigned x = 0; x < width; x += s) {
+			size_t i = lowestGradient(ws.gradients, width, height, x, y, params.seedWindow);
+			ws.centers.push_back(centerAt(ws, i, width));
+		}
+	}
+}
+
+// Sum of the central differences in x and y, where <l>/<r> and <up>/<down>
+// are the offsets of the horizontal and vertical neighbors.
+static inline float gradientAt(const float *c0, const float *c1, const float *c2, size_t i,
+		ptrdiff_t l, ptrdiff_t r, ptrdiff_t up, ptrdiff_t down)
+{
+	float x0 = c0[i + r] - c0[i + l];
+	float x1 = c1[i + r] - c1[i + l];
+	float x2 = c2[i + r] - c2[i + l];
+	float y0 = c0[i + down] - c0[i + up];
+	float y1 = c1[i + down] - c1[i + up];
+	float y2 = c2[i + down] - c2[i + up];
+
+	return sqrtf(x0*x0 + x1*x1 + x2*x2) + sqrtf(y0*y0 + y1*y1 + y2*y2);
+}
+
+void Slic::gradientMap()
+{
+	SlicWorkspace &ws = *workspace;
+	ws.gradients.resize((size_t) width * height);
+
+	parallelFor(threads, height, [&](size_t begin, size_t end, unsigned) {
+		const float *c0 = ws.c0.data(), *c1 = ws.c1.data(), *c2 = ws.c2.data();
+
+		for (size_t y = begin; y < end; ++y) {
+			size_t row = y * width;
+			float *out = &ws.gradients[row];
+			ptrdiff_t up = y > 0 ? -(ptrdiff_t) width : 0;
+			ptrdiff_t down = y + 1 < height ? width : 0;
+
+			if (width == 1) {
+				out[0] = gradientAt(c0, c1, c2, row, 0, 0, up, down);
+				continue;
+			}
+
+			out[0] = gradientAt(c0, c1, c2, row, 0, 1, up, down);
+			for (size_t x = 1; x + 1 < width; ++x) {
+				out[x] = gradientAt(c0, c1, c2, row + x, -1, 1, up, down);
+			}
+			out[width - 1] = gradientAt(c0, c1, c2, row + width - 1, -1, 0, up, down);
+		}
+	}, &ws.pool);
+}
+
+void Slic::seedCoarse(const Image &img, int s, std::vector<float> &residuals)
+{
+	const int f = params.downscale;
+
+	Image &small = workspace->small;
+	{
+		ScopedTimer timer(times ? &times->convert : nullptr);
+		img.downscale(f, small, threads, &workspace->pool);
+	}
+
+	// Distances shrink by <f> along with the image, and the spatial
+	// term is not normalized by S, so the compactness has to grow by
+	// the same factor to keep the balance against color.
+	SlicParams coarse = params;
+	coarse.compactness = params.compactness * f;
+	coarse.downscale = 1;
+
+	// Shares the workspace, so the small planes are allocated from the
+	// buffers that the full resolution pass reuses afterwards.
+	Slic slic(coarse, workspace);
+	slic.times = times;
+	slic.pixelSize = f;
+
+	{
+		ScopedTimer timer(times ? &times->convert : nullptr);
+		slic.load(small);
+	}
+
+	// Seeds on the full resolution grid, so that both resolutions end
+	// up with the same centers, in the same order.
+	{
+		ScopedTimer timer(times ? &times->seeding : nullptr);
+		slic.gradientMap();
+		workspace->centers.clear();
+
+		for (unsigned y = 0; y < img.height; y += s) {
+			for (unsigned x = 0; x < img.width; x += s) {
+				size_t i = lowestGradient(workspace->gradients, slic.width, slic.height,
+					x / f, y / f, params.seedWindow);
+				workspace->centers.push_back(centerAt(*workspace, i, slic.width));
+			}
+		}
+	}
+
+	slic.iterate(std::max(s / f, 1), params.iterations, residuals);
+
+	// A small pixel covers an f x f block of the image, whose middle
+	// is (f - 1) / 2 pixels in.
+	for (Center &center : workspace->centers) {
+		center.x = std::min(center.x * f + (f - 1) / 2.0f, (float) img.width - 1);
+		center.y = std::min(center.y * f + (f - 1) / 2.0f, (float) img.height - 1);
+	}
+}
+
+// The window of pixels a center competes for, clipped to the image.
+struct Window {
+	int x0, y0, x1, y1;
+};
+
+static Window window(const Center &center, int s, unsigned width, unsigned height)
+{
+	Window win;
+	win.x0 = std::max((int) (center.x - s), 0);
+	win.y0 = std::max((int) (center.y - s), 0);
+	win.x1 = std::min((int) (center.x + s), (int) width - 1);
+	win.y1 = std::min((int) (center.y + s), (int) height - 1);
+	return win;
+}
+
+static bool moved(const Center &a, const Center &b, float epsilon)
+{
+	return fabsf(a.c0 - b.c0) > epsilon || fabsf(a.c1 - b.c1) > epsilon ||
+		fabsf(a.c2 - b.c2) > epsilon || fabsf(a.x - b.x) > epsilon ||
+		fabsf(a.y - b.y) > epsilon;
+}
+
+void Slic::markChanged(int s)
+{
+	SlicWorkspace &ws = *workspace;
+	blocksX = (width + s - 1) / s;
+	blocksY = (height + s - 1) / s;
+
+	bool all = !params.incremental || ws.previous.size() != ws.centers.size();
+	ws.dirty.assign(blocksX * blocksY, all);
+
+	// Blocks whose pixels changed since they were assigned, as set up
+	// by a warm start. They only apply to the first pass.
+	if (!all && ws.changed.size() == ws.dirty.size()) {
+		for (size_t i = 0; i < ws.dirty.size(); ++i) {
+			ws.dirty[i] |= ws.changed[i];
+		}
+	}
+	ws.changed.clear();
+
+	// A pixel has to be reconsidered if it lies in the old or the new
+	// window of a center that moved, as its stored distance may then
+	// be stale.
+	auto mark = [&](const Window &win) {
+		for (int by = win.y0 / s; by <= win.y1 / s; ++by) {
+			for (int bx = win.x0 / s; bx <= win.x1 / s; ++bx) {
+				ws.dirty[by * blocksX + bx] = 1;
+			}
+		}
+	};
+
+	if (!all) {
+		for (size_t k = 0; k < ws.centers.size(); ++k) {
+			if (moved(ws.previous[k], ws.centers[k], params.epsilon)) {
+				mark(window(ws.previous[k], s, width, height));
+				mark(window(ws.centers[k], s, width, height));
+			}
+		}
+	}
+
+	// Every center whose window touches a dirty block competes for the
+	// pixels in it again. This includes all centers that can reach a
+	// reset pixel, so those end up with the same label as after a full
+	// rescan.
+	ws.active.clear();
+	for (size_t k = 0; k < ws.centers.size(); ++k) {
+		Window win = window(ws.centers[k], s, width, height);
+		bool touched = all;
+
+		for (int by = win.y0 / s; by <= win.y1 / s && !touched; ++by) {
+			for (int bx = win.x0 / s; bx <= win.x1 / s && !touched; ++bx) {
+				touched = ws.dirty[by * blocksX + bx];
+			}
+		}
+
+		if (touched)
+			ws.active.push_back(k);
+	}
+}
+
+void Slic::assign(int s)
+{
+	SlicWorkspace &ws = *workspace;
+	// D = sqrt(dc^2 + (ds/2)^2 * c^2). Only the order of distances
+	// matters, so the planes hold D^2 and the spatial weight is folded
+	// into a single factor.
+	static const AssignRowFn assignRow = assignRowKernel();
+	const float w = (params.compactness / 2) * (params.compactness / 2);
+
+	markChanged(s);
+
+	// Every thread owns the rows [begin, end) and clips the windows of
+	// the active centers to them. The centers are visited in the same
+	// order as with a single thread, so each pixel sees the same
+	// sequence of comparisons no matter which band it falls in.
+	parallelFor(threads, height, [&](size_t begin, size_t end, unsigned) {
+		for (size_t y = begin; y < end; ++y) {
+			const uint8_t *blocks = &ws.dirty[(y / s) * blocksX];
+			for (unsigned bx = 0; bx < blocksX; ++bx) {
+				if (!blocks[bx])
+					continue;
+
+				size_t x0 = bx * s;
+				size_t x1 = std::min(x0 + s, (size_t) width);
+				std::fill(&ws.dists[y * width + x0], &ws.dists[y * width] + x1, FLT_MAX);
+			}
+		}
+
+		for (uint32_t k : ws.active) {
+			const Center &center = ws.centers[k];
+			Window win = window(center, s, width, height);
+			int y0 = std::max(win.y0, (int) begin);
+			int y1 = std::min(win.y1, (int) end - 1);
+
+			for (int y = y0; y <= y1; ++y) {
+				const uint8_t *blocks = &ws.dirty[(y / s) * blocksX];
+				size_t row = (size_t) y * width;
+				float dy = y - center.y;
+
+				// Only scan the runs of dirty blocks, everything
+				// else already holds its final distance.
+				int x = win.x0;
+				while (x <= win.x1) {
+					if (!blocks[x / s]) {
+						x = (x / s + 1) * s;
+						continue;
+					}
+
+					int x1 = x;
+					while (x1 <= win.x1 && blocks[x1 / s])
+						x1 = (x1 / s + 1) * s;
+					x1 = std::min(x1, win.x1 + 1);
+
+					assignRow(&ws.c0[row], &ws.c1[row], &ws.c2[row], &ws.dists[row], &ws.labels[row],
+						x, x1 - x, dy*dy, w, center, k);
+					x = x1;
+				}
+			}
+		}
+	}, &ws.pool);
+}
+
+float Slic::update()
+{
+	SlicWorkspace &ws = *workspace;
+	const size_t n = ws.centers.size();
+	const unsigned used = std::min<size_t>(threads, height);
+	const size_t step = std::max(params.subsample, 1);
+	std::vector<Accumulator> &partials = ws.partials;
+	std::vector<float> &moves = ws.moves;
+
+	partials.resize(used * n);
+	moves.assign(n, 0.0f);
+
+	ws.previous = ws.centers;
+
+	parallelFor(threads, height, [&](size_t begin, size_t end, unsigned t) {
+		Accumulator *acc = &partials[t * n];
+		std::fill(acc, acc + n, Accumulator());
+
+		// The sampled rows are fixed multiples of <step>, so the sums
+		// do not depend on where the bands start.
+		for (size_t y = (begin + step - 1) / step * step; y < end; y += step) {
+			size_t row = y * width;
+			for (size_t x = 0; x < width; x += step) {
+				int32_t l = ws.labels[row + x];
+				if (l == -1)
+					continue;
+
+				acc[l].c0 += lrintf(ws.c0[row + x] * FIXED_ONE);
+				acc[l].c1 += lrintf(ws.c1[row + x] * FIXED_ONE);
+				acc[l].c2 += lrintf(ws.c2[row + x] * FIXED_ONE);
+				acc[l].x += x;
+				acc[l].y += y;
+				acc[l].count += 1;
+			}
+		}
+	}, &ws.pool);
+
+	parallelFor(threads, n, [&](size_t begin, size_t end, unsigned) {
+		for (size_t k = begin; k < end; ++k) {
+			Accumulator sum = partials[k];
+			for (size_t t = 1; t < used; ++t) {
+				const Accumulator &acc = partials[t * n + k];
+				sum.c0 += acc.c0;
+				sum.c1 += acc.c1;
+				sum.c2 += acc.c2;
+				sum.x += acc.x;
+				sum.y += acc.y;
+				sum.count += acc.count;
+			}
+
+			// Centers that lost all of their pixels keep their
+			// previous value rather than collapsing to NaN.
+			if (!sum.count)
+				continue;
+
+			double count = sum.count;
+			float x = sum.x / count;
+			float y = sum.y / count;
+
+			moves[k] = fabsf(x - ws.centers[k].x) + fabsf(y - ws.centers[k].y);
+			ws.centers[k].c0 = (double) sum.c0 / FIXED_ONE / count;
+			ws.centers[k].c1 = (double) sum.c1 / FIXED_ONE / count;
+			ws.centers[k].c2 = (double) sum.c2 / FIXED_ONE / count;
+			ws.centers[k].x = x;
+			ws.centers[k].y = y;
+		}
+	}, &ws.pool);
+
+	// Residual error E: the L1 distance the centers moved, averaged
+	// over all centers. Summed in center order, so it does not depend
+	// on the thread count either.
+	double residual = 0.0;
+	for (size_t k = 0; k < n; ++k) {
+		residual += moves[k];
+	}
+
+	return n ? residual / n : 0.0f;
+}
+
+void Slic::gatherClusters(const Image &img, SlicResult &result, size_t n) const
+{
+	SlicWorkspace &ws = *workspace;
+	const int32_t *labels = result.labels.data();
+	const unsigned used = std::min<size_t>(threads, height);
+	std::vector<Accumulator> &partials = ws.partials;
+
+	partials.resize(used * n);
+
+	parallelFor(threads, height, [&](size_t begin, size_t end, unsigned t) {
+		Accumulator empty = Accumulator();
+		empty.x0 = empty.y0 = UINT32_MAX;
+
+		Accumulator *acc = &partials[t * n];
+		std::fill(acc, acc + n, empty);
+
+		for (size_t y = begin; y < end; ++y) {
+			size_t row = y * width;
+			for (size_t x = 0; x < width; ++x) {
+				int32_t l = labels[row + x];
+				if (l == -1)
+					continue;
+
+				const unsigned char *px = &img.data[3 * (row + x)];
+				acc[l].c0 += px[0];
+				acc[l].c1 += px[1];
+				acc[l].c2 += px[2];
+				acc[l].x += x;
+				acc[l].y += y;
+				acc[l].count += 1;
+				acc[l].x0 = std::min<uint32_t>(acc[l].x0, x);
+				acc[l].x1 = std::max<uint32_t>(acc[l].x1, x);
+				acc[l].y0 = std::min<uint32_t>(acc[l].y0, y);
+				acc[l].y1 = std::max<uint32_t>(acc[l].y1, y);
+			}
+		}
+	}, &ws.pool);
+
+	result.clusters.assign(n, Cluster());
+	for (size_t k = 0; k < n; ++k) {
+		Accumulator sum = Accumulator();
+		sum.x0 = sum.y0 = UINT32_MAX;
+
+		for (size_t t = 0; t < used; ++t) {
+			const Accumulator &acc = partials[t * n + k];
+			sum.c0 += acc.c0;
+			sum.c1 += acc.c1;
+			sum.c2 += acc.c2;
+			sum.x += acc.x;
+			sum.y += acc.y;
+			sum.count += acc.count;
+			sum.x0 = std::min(sum.x0, acc.x0);
+			sum.x1 = std::max(sum.x1, acc.x1);
+			sum.y0 = std::min(sum.y0, acc.y0);
+			sum.y1 = std::max(sum.y1, acc.y1);
+		}
+
+		result.clusters[k] = toCluster(sum);
+	}
+}
+
+Cluster toCluster(const Accumulator &sum)
+{
+	Cluster cluster = Cluster();
+	cluster.count = sum.count;
+	if (!sum.count)
+		return cluster;
+
+	cluster.x0 = sum.x0;
+	cluster.y0 = sum.y0;
+	cluster.x1 = sum.x1;
+	cluster.y1 = sum.y1;
+
+	double count = sum.count;
+	cluster.r = sum.c0 / count;
+	cluster.g = sum.c1 / count;
+	cluster.b = sum.c2 / count;
+	cluster.x = sum.x / count;
+	cluster.y = sum.y / count;
+	return cluster;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+#include "image.h"
+#include "timer.h"
+#include "connectivity.h"
+#include "parallel.h"
+
+#define ITERATIONS 10
+
+// Default compactness per color space. Distances in LAB are about 3 times
+// smaller than in RGB, and 13 gives about the same boundary length as 40
+// does in RGB.
+#define COMPACTNESS 40.0f
+#define LAB_COMPACTNESS 13.0f
+
+// Space the color distance is measured in. The compactness is used as is,
+// so it has to be set to match the color space, see LAB_COMPACTNESS.
+enum class ColorSpace {
+	RGB,
+	LAB,
+};
+
+struct SlicParams {
+	// Desired number of superpixels. Ignored if <step> is set.
+	int superpixels = 800;
+	// Grid interval S between the initial centers.
+	int step = 0;
+	// Seeds are moved to the lowest gradient position in a window of
+	// seedWindow x seedWindow pixels around their grid position.
+	int seedWindow = 3;
+	// Weight of the spatial distance against the color distance.
+	float compactness = COMPACTNESS;
+	// Iteration cap.
+	int iterations = ITERATIONS;
+	// Stop as soon as the residual error E drops below this. 0 always
+	// runs all <iterations>.
+	float threshold = 0.0f;
+	// Only rescan the windows of centers that moved by more than
+	// <epsilon> in any of their five components since the last pass,
+	// and those of their neighbors. With an epsilon of 0 the result is
+	// identical to a full rescan.
+	bool incremental = false;
+	float epsilon = 0.0f;
+	// Give every connected segment its own label. Otherwise a segment
+	// keeps the index of its center, which is stable across calls that
+	// start from the same seeds, but may cover several segments.
+	bool relabel = true;
+	// Also build the region adjacency graph of the superpixels.
+	bool adjacency = false;
+	ColorSpace colorSpace = ColorSpace::RGB;
+	// Fast mode. The center update only samples every <subsample>th
+	// pixel of every <subsample>th row.
+	int subsample = 1;
+	// Coarse to fine: above 1, all <iterations> run on the image shrunk
+	// by this factor, followed by <refine> iterations at full resolution
+	// that start from the scaled up centers.
+	int downscale = 1;
+	// Iterations that refine a segmentation that did not start from the
+	// grid: after the coarse pass, or from the last frame in TemporalSlic.
+	// Fewer are faster, more let superpixels follow motion more closely.
+	int refine = 2;
+	// Worker threads, 0 means all cores.
+	unsigned threads = 1;
+	bool verbose = false;
+
+	int gridStep(unsigned width, unsigned height) const;
+	// Sets the fast mode fields to a preset for previews and thumbnails.
+	void fast();
+};
+
+// A cluster center in the five dimensional [c0 c1 c2 x y] space that
+// SLIC clusters in.
+struct Center {
+	float c0, c1, c2;
+	float x, y;
+};
+
+// Statistics of a superpixel, gathered from the final label map after
+// connectivity has been enforced.
+struct Cluster {
+	float r, g, b;
+	float x, y;
+	uint32_t count;
+	// Bounding box, inclusive. All zero for empty clusters.
+	uint32_t x0, y0, x1, y1;
+};
+
+struct SlicResult {
+	unsigned width, height;
+	std::vector<int32_t> labels;
+	std::vector<Cluster> clusters;
+	// Residual error E after each iteration that was run: the mean L1
+	// distance, in pixels of the image, that the centers moved.
+	std::vector<float> residuals;
+	// Only filled in if SlicParams::adjacency is set.
+	RegionGraph graph;
+};
+
+// Exact per-thread partial sums of the center update.
+struct Accumulator {
+	int64_t c0, c1, c2;
+	int64_t x, y;
+	int64_t count;
+	// Bounding box, only kept by gatherClusters().
+	uint32_t x0, y0, x1, y1;
+};
+
+// Means and bounding box of the pixels summed up in <sum>.
+Cluster toCluster(const Accumulator &sum);
+
+// All per-image scratch memory of a segmentation. Buffers only ever grow,
+// so a workspace that is kept around stops allocating (and page faulting)
+// once it has seen the largest image. One workspace serves all worker
+// threads of a segmentation, but it must not be used by two segmentations
+// at the same time.
+struct SlicWorkspace {
+	// Runs every parallel pass of the segmentations that use this
+	// workspace, so their threads are started once, not per pass.
+	ThreadPool pool;
+
+	// Planes, indexed by y*width + x.
+	std::vector<float> c0, c1, c2;
+	std::vector<int32_t> labels;
+	std::vector<float> dists; // Squared distances.
+	std::vector<float> gradients;
+	// Downscaled copy of the image for coarse to fine seeding.
+	Image small = Image(0, 0);
+
+	std::vector<Center> centers;
+	std::vector<Accumulator> partials;
+	std::vector<float> moves;
+
+	// Incremental assignment state. The image is divided into S x S
+	// blocks, and only the dirty blocks are reset and rescanned by the
+	// active centers.
+	std::vector<Center> previous;
+	std::vector<uint8_t> dirty;
+	// Blocks to rescan on the next pass in any case, e.g. because the
+	// image changed underneath the labels.
+	std::vector<uint8_t> changed;
+	std::vector<uint32_t> active;
+
+	// Breadth-first queue of the connectivity pass, and the label
+	// boundaries it collects for the adjacency graph.
+	std::vector<int32_t> queue;
+	std::vector<BoundaryRun> boundaries;
+
+	// Bytes currently reserved by all buffers.
+	size_t capacity() const;
+};
+
+// Planar SLIC engine. Every per-pixel quantity lives in its own
+// contiguous plane indexed by y*width + x, and pixel coordinates are
+// implied by the index instead of being stored. The 2S x 2S window
+// scan around a center thus only walks a few short runs of floats per
+// row.
+//
+// With more than one thread, assignment splits the image into row bands
+// that each thread owns exclusively, and the center update reduces exact
+// per-thread partial sums. Output is bit-identical for any thread count.
+//
+// The engine does not depend on a window system and leaves the input
+// image untouched. A Slic can segment any number of images. All scratch
+// memory lives in a SlicWorkspace, which can be shared by Slics with
+// different parameters as long as they do not run at the same time.
+struct Slic {
+	SlicParams params;
+	unsigned threads;
+	unsigned width, height;
+	unsigned blocksX = 0, blocksY = 0;
+	// Pixels of the image per pixel of the planes along each axis, when
+	// they hold a downscaled copy. Residuals are scaled by it, so that
+	// they and SlicParams::threshold are in pixels of the image.
+	float pixelSize = 1.0f;
+
+	// If set, the wall time of every stage is added to it.
+	StageTimes *times = nullptr;
+
+	SlicWorkspace *workspace;
+	std::unique_ptr<SlicWorkspace> own;
+
+	// Without a <workspace>, the Slic allocates one of its own.
+	Slic(const SlicParams &params = SlicParams(), SlicWorkspace *workspace = nullptr);
+
+	// An image without pixels gives an empty result, of size 0 x 0.
+	SlicResult segment(const Image &img);
+	// Same, but reuses the buffers of <result>.
+	void segment(const Image &img, SlicResult &result);
+
+	// Converts <img> into the planes. With <keep>, the labels, distances
+	// and centers of the last segmentation are kept if <img> has the same
+	// size, so that a similar image can continue from them.
+	void load(const Image &img, bool keep = false);
+	// Seeds one center per cell of a grid with step s, in raster order:
+	// center k starts in cell (k % gridWidth, k / gridWidth).
+	// It is then moved to the lowest gradient in the seedWindow x
+	// seedWindow neighborhood of its grid point.
+	void seed(int s);
+	// Gradient magnitude of the planes into workspace->gradients: the
+	// norm of the central difference in x plus that in y, with the
+	// neighbors clamped at the edges. Seeds thus avoid the edges of the
+	// color space that is clustered in.
+	void gradientMap();
+	// Seeds by segmenting a downscaled copy of <img>, and leaves the
+	// centers in full resolution coordinates.
+	void seedCoarse(const Image &img, int s, std::vector<float> &residuals);
+	// Runs up to <iterations> of assignment and update, appending the
+	// residual error of each to <residuals>.
+	void iterate(int s, int iterations, std::vector<float> &residuals);
+	void markChanged(int s);
+	void assign(int s);
+	float update();
+	// Enforces connectivity and gathers the statistics into <result>.
+	void finish(const Image &img, SlicResult &result);
+	void gatherClusters(const Image &img, SlicResult &result, size_t n) const;
+};
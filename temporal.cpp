@@ -0,0 +1,101 @@
+#include "temporal.h"
+#include "parallel.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+static SlicParams temporalParams(SlicParams params)
+{
+	// Stable IDs need the center index as label, and restricting work
+	// to the changed blocks is what incremental assignment does.
+	params.relabel = false;
+	params.incremental = true;
+	// Centers keep drifting by fractions of a pixel from frame to frame,
+	// which must not count as movement, or every window is rescanned.
+	if (params.epsilon <= 0.0f)
+		params.epsilon = 1.0f;
+	return params;
+}
+
+TemporalSlic::TemporalSlic(const SlicParams &params, SlicWorkspace *workspace)
+	: slic(temporalParams(params), workspace)
+{
+	;
+}
+
+void TemporalSlic::reset()
+{
+	previous.clear();
+}
+
+size_t TemporalSlic::markChanges(const Image &frame, int s)
+{
+	const unsigned width = frame.width, height = frame.height;
+	const unsigned blocksX = (width + s - 1) / s;
+	const unsigned blocksY = (height + s - 1) / s;
+	std::vector<uint8_t> &changed = slic.workspace->changed;
+
+	changed.assign(blocksX * blocksY, 0);
+
+	parallelFor(slic.threads, blocksY, [&](size_t begin, size_t end, unsigned) {
+		std::vector<uint64_t> sums(blocksX);
+
+		for (size_t by = begin; by < end; ++by) {
+			size_t y0 = by * s, y1 = std::min(y0 + s, (size_t) height);
+			std::fill(sums.begin(), sums.end(), 0);
+
+			for (size_t y = y0; y < y1; ++y) {
+				const unsigned char *a = &frame.data[3 * y * width];
+				const unsigned char *b = &previous[3 * y * width];
+
+				for (size_t x = 0; x < width; ++x) {
+					sums[x / s] += abs(a[3*x] - b[3*x]) + abs(a[3*x + 1] - b[3*x + 1]) +
+						abs(a[3*x + 2] - b[3*x + 2]);
+				}
+			}
+
+			for (size_t bx = 0; bx < blocksX; ++bx) {
+				size_t x0 = bx * s, x1 = std::min(x0 + s, (size_t) width);
+				double samples = 3.0 * (x1 - x0) * (y1 - y0);
+				changed[by * blocksX + bx] = sums[bx] > changeThreshold * samples;
+			}
+		}
+	}, &slic.workspace->pool);
+
+	size_t count = 0;
+	for (uint8_t c : changed) {
+		count += c;
+	}
+
+	return count;
+}
+
+void TemporalSlic::segment(const Image &frame, SlicResult &result)
+{
+	const size_t size = frame.data.size();
+
+	if (previous.size() != size || slic.width != frame.width || slic.height != frame.height) {
+		slic.segment(frame, result);
+		previous = frame.data;
+		return;
+	}
+
+	int s = slic.params.gridStep(frame.width, frame.height);
+
+	{
+		ScopedTimer timer(slic.times ? &slic.times->convert : nullptr);
+		markChanges(frame, s);
+		slic.load(frame, true);
+	}
+
+	// The centers converged on the previous frame, so only the changed
+	// blocks are dirty in the first pass, not the windows of centers that
+	// moved in its last update.
+	slic.workspace->previous = slic.workspace->centers;
+
+	result.residuals.clear();
+	slic.iterate(s, slic.params.refine, result.residuals);
+	slic.finish(frame, result);
+
+	previous.assign(frame.data.begin(), frame.data.end());
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "image.h"
+#include "slic.h"
+
+// Segments the frames of a video one after the other. The first frame is
+// segmented from scratch. Every later frame of the same size starts from
+// the converged centers, labels and distances of the frame before, and
+// runs only SlicParams::refine iterations of incremental assignment,
+// seeded with the S x S blocks whose pixels changed. Without an epsilon in
+// the parameters, centers that moved by up to 1 are treated as still.
+//
+// Connected segments keep the index of their center as label, so a
+// superpixel keeps its ID for as long as its center survives.
+struct TemporalSlic {
+	Slic slic;
+	// A block counts as changed if the mean absolute difference of its
+	// RGB samples to the previous frame exceeds this.
+	float changeThreshold = 2.0f;
+
+	// RGB of the last frame, to find the changed blocks.
+	std::vector<unsigned char> previous;
+
+	TemporalSlic(const SlicParams &params, SlicWorkspace *workspace = nullptr);
+
+	void segment(const Image &frame, SlicResult &result);
+	// Forgets the previous frame, e.g. at a scene cut.
+	void reset();
+
+	// Marks the blocks of step s in which <frame> differs from
+	// <previous>, into workspace->changed. Returns the number of them.
+	size_t markChanges(const Image &frame, int s);
+};
@@ -0,0 +1,443 @@
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "image.h"
+#include "io.h"
+#include "slic.h"
+#include "distance.h"
+#include "connectivity.h"
+#include "labelmap.h"
+#include "tiled.h"
+#include "temporal.h"
+#include "util.h"
+
+// Checks that optimizations must not break. Most run the fast path and a
+// plain reference on the same input and compare the results bit for bit,
+// the others feed in empty or corrupt input. Run with make check.
+
+static int failures = 0;
+
+static void check(bool ok, const char *name)
+{
+	println((ok ? "ok    " : "FAIL  ") << name);
+	failures += !ok;
+}
+
+static uint32_t state = 12345;
+
+static float random01()
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) / 16777216.0f;
+}
+
+// An image without pixels, as left by a failed decode, gives an empty
+// result rather than a crash.
+static void checkEmpty()
+{
+	SlicParams params;
+	params.adjacency = true;
+	SlicResult result = Slic(params).segment(Image(0, 0));
+
+	check(result.width == 0 && result.height == 0 && result.labels.empty() &&
+		result.clusters.empty(), "an empty image gives an empty result");
+}
+
+// The SIMD assignment kernels claim the same pixels with the same
+// distances as the scalar one, for any start and length of the run.
+static void checkKernels()
+{
+	const int width = 80;
+	std::vector<float> c0(width), c1(width), c2(width);
+	for (int x = 0; x < width; ++x) {
+		c0[x] = 255 * random01();
+		c1[x] = 255 * random01();
+		c2[x] = 255 * random01();
+	}
+
+	std::vector<AssignRowFn> kernels;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		kernels.push_back(assignRowSse2);
+	if (__builtin_cpu_supports("avx2"))
+		kernels.push_back(assignRowAvx2);
+#endif
+
+	bool ok = true;
+	for (int trial = 0; trial < 200 && ok; ++trial) {
+		Center center = {255 * random01(), 255 * random01(), 255 * random01(),
+			width * random01(), 0};
+		int x0 = trial % 17;
+		int n = (trial * 7) % (width - x0 + 1);
+		float dy2 = 100 * random01();
+		float w = 10 * random01();
+
+		std::vector<float> dists(width);
+		std::vector<int32_t> labels(width, -1);
+		for (int x = 0; x < width; ++x) {
+			dists[x] = trial % 2 ? 30000 * random01() : 1e30f;
+		}
+
+		std::vector<float> expectDists = dists;
+		std::vector<int32_t> expectLabels = labels;
+		assignRowScalar(c0.data(), c1.data(), c2.data(), expectDists.data(), expectLabels.data(),
+			x0, n, dy2, w, center, 7);
+
+		for (AssignRowFn kernel : kernels) {
+			std::vector<float> d = dists;
+			std::vector<int32_t> l = labels;
+			kernel(c0.data(), c1.data(), c2.data(), d.data(), l.data(), x0, n, dy2, w, center, 7);
+			ok = ok && memcmp(d.data(), expectDists.data(), width * sizeof(float)) == 0 &&
+				l == expectLabels;
+		}
+	}
+
+	check(ok, "SIMD assignment kernels match the scalar kernel");
+}
+
+static bool sameLabels(const SlicResult &a, const SlicResult &b)
+{
+	return a.labels == b.labels && a.residuals == b.residuals;
+}
+
+// Incremental assignment with an epsilon of 0 rescans every pixel whose
+// label could change, so it ends up with the labels of a full rescan.
+static void checkIncremental(const Image &img)
+{
+	SlicParams params;
+	params.superpixels = 600;
+	params.iterations = 15;
+
+	SlicResult full = Slic(params).segment(img);
+
+	params.incremental = true;
+	params.epsilon = 0.0f;
+	SlicResult incremental = Slic(params).segment(img);
+
+	check(sameLabels(full, incremental), "incremental assignment with epsilon 0 matches a full rescan");
+}
+
+// A frame that did not change leaves nothing to reassign, so it keeps the
+// labels of the frame before.
+static void checkTemporal(const Image &img)
+{
+	SlicParams params;
+	params.superpixels = 600;
+
+	TemporalSlic temporal(params);
+	SlicResult first, second;
+	temporal.segment(img, first);
+	temporal.segment(img, second);
+
+	const std::vector<uint8_t> &dirty = temporal.slic.workspace->dirty;
+	check(std::count(dirty.begin(), dirty.end(), 1) == 0, "an unchanged frame has no dirty blocks");
+	check(first.labels == second.labels, "an unchanged frame keeps its labels");
+}
+
+// Row bands and exact partial sums make the result independent of the
+// thread count.
+static void checkThreads(const Image &img)
+{
+	SlicParams params;
+	params.superpixels = 600;
+
+	SlicResult single = Slic(params).segment(img);
+
+	bool ok = true;
+	for (unsigned threads : {3u, 7u}) {
+		params.threads = threads;
+		ok = ok && sameLabels(single, Slic(params).segment(img));
+	}
+
+	check(ok, "labels are the same for 1, 3 and 7 threads");
+}
+
+// The region adjacency graph lists every pair of labels that touch, with
+// the number of 4-neighbor pixel pairs between them, as counted by a
+// scan over all pixel pairs.
+static void checkRegionGraph(const Image &img)
+{
+	SlicParams params;
+	params.superpixels = 600;
+	params.adjacency = true;
+
+	SlicResult result = Slic(params).segment(img);
+	const RegionGraph &graph = result.graph;
+	const unsigned width = result.width, height = result.height;
+	const size_t n = result.clusters.size();
+
+	std::map<std::pair<int32_t, int32_t>, uint32_t> pairs;
+	auto add = [&](int32_t a, int32_t b) {
+		if (a != b) {
+			++pairs[std::make_pair(a, b)];
+			++pairs[std::make_pair(b, a)];
+		}
+	};
+
+	for (unsigned y = 0; y < height; ++y) {
+		for (unsigned x = 0; x < width; ++x) {
+			int32_t l = result.labels[(size_t) y * width + x];
+			if (x + 1 < width)
+				add(l, result.labels[(size_t) y * width + x + 1]);
+			if (y + 1 < height)
+				add(l, result.labels[(size_t) (y + 1) * width + x]);
+		}
+	}
+
+	bool ok = graph.offsets.size() == n + 1 && graph.neighbors.size() == pairs.size() &&
+		graph.lengths.size() == pairs.size() && graph.colorDiffs.size() == pairs.size();
+
+	auto it = pairs.begin();
+	for (size_t k = 0; k < n && ok; ++k) {
+		for (uint32_t e = graph.offsets[k]; e < graph.offsets[k + 1] && ok; ++e, ++it) {
+			const Cluster &a = result.clusters[k];
+			const Cluster &b = result.clusters[graph.neighbors[e]];
+			float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+
+			ok = it->first == std::make_pair((int32_t) k, graph.neighbors[e]) &&
+				it->second == graph.lengths[e] &&
+				graph.colorDiffs[e] == sqrtf(dr*dr + dg*dg + db*db);
+		}
+	}
+
+	check(ok && it == pairs.end(), "region adjacency graph matches a scan of all pixel pairs");
+}
+
+static bool roundTrip(const SlicResult &result, const char *path)
+{
+	if (!saveLabelMap(path, result))
+		return false;
+
+	LabelMap map(path);
+	std::vector<int32_t> labels;
+	return map.header && map.labels(labels) && labels == result.labels &&
+		map.header->clusters == result.clusters.size() &&
+		memcmp(map.clusters, result.clusters.data(), result.clusters.size() * sizeof(Cluster)) == 0;
+}
+
+// Overwrites <size> bytes at <offset> of the file at <path>.
+static void patch(const char *path, long offset, const void *bytes, size_t size)
+{
+	FILE *file = fopen(path, "r+b");
+	fseek(file, offset, SEEK_SET);
+	fwrite(bytes, 1, size, file);
+	fclose(file);
+}
+
+// Label maps give back the labels and statistics they were written with,
+// including label -1, in both label widths. Files whose runs do not add
+// up, or whose cluster table lies beyond the end, are rejected.
+static void checkLabelMap(const Image &img)
+{
+	char path[] = "/tmp/checks-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		check(false, "label maps round trip");
+		return;
+	}
+	close(fd);
+
+	SlicParams params;
+	params.superpixels = 600;
+	SlicResult result = Slic(params).segment(img);
+	result.labels[5] = -1;
+
+	bool ok = roundTrip(result, path);
+
+	// More clusters than uint16 labels can hold.
+	SlicResult wide = result;
+	wide.clusters.resize(0x10000);
+	wide.labels[6] = 0xFFFF;
+	ok = ok && roundTrip(wide, path);
+
+	// Label -1 is the only negative label the format can hold.
+	result.labels[5] = -2;
+	ok = ok && !saveLabelMap(path, result);
+	result.labels[5] = -1;
+	check(ok, "label maps round trip, with label -1");
+
+	// The first run of row 0 one pixel short.
+	saveLabelMap(path, result);
+	long runs = sizeof(LabelMapHeader) + (result.height + 1) * sizeof(uint64_t);
+	uint16_t length;
+	{
+		LabelMap map(path);
+		length = ((const uint16_t *) map.runs)[1] - 1;
+	}
+	patch(path, runs + sizeof(uint16_t), &length, sizeof(length));
+
+	std::vector<int32_t> labels(result.width);
+	LabelMap shortRow(path);
+	ok = shortRow.header && !shortRow.row(0, labels.data()) && !shortRow.labels(labels);
+
+	// A cluster table that wraps around the end of the file.
+	saveLabelMap(path, result);
+	uint64_t statsOffset = UINT64_MAX & ~(uint64_t) 7;
+	patch(path, offsetof(LabelMapHeader, statsOffset), &statsOffset, sizeof(statsOffset));
+	LabelMap wrapped(path);
+	ok = ok && !wrapped.header;
+
+	check(ok, "label maps with inconsistent runs or offsets are rejected");
+
+	// Written a few rows at a time, the file is the same as in one go.
+	// Needs statistics that match the labels.
+	result = Slic(params).segment(img);
+	std::vector<unsigned char> expect, written;
+	encodeLabelMap(expect, result);
+
+	LabelMapWriter writer;
+	ok = writer.open(path, result.width, result.height, result.clusters.size());
+	for (unsigned y = 0; y < result.height && ok; y += 37) {
+		unsigned rows = std::min(37u, result.height - y);
+		ok = writer.write(rows, &result.labels[(size_t) y * result.width],
+			&img.data[3 * (size_t) y * img.width]);
+	}
+	ok = writer.close() && ok;
+
+	FILE *file = fopen(path, "rb");
+	written.resize(expect.size() + 1);
+	ok = ok && file && fread(written.data(), 1, written.size(), file) == expect.size();
+	written.resize(expect.size());
+	if (file)
+		fclose(file);
+
+	check(ok && written == expect, "label maps written by rows match those written at once");
+	unlink(path);
+}
+
+// Bands have to agree on the labels across their seams. One band is the
+// whole image, and with more, labels change from the last row of a band to
+// the first row of the next about as often as between any two rows.
+// Small fragments at seams may remain, see segmentTiled().
+static void checkTiled(const Image &img)
+{
+	SlicParams params;
+	params.superpixels = 800;
+
+	std::vector<int32_t> labels;
+	std::vector<unsigned> seams;
+	auto collect = [&](unsigned y, unsigned rows, const int32_t *band, const unsigned char *) {
+		if (y)
+			seams.push_back(y);
+		labels.insert(labels.end(), band, band + (size_t) rows * img.width);
+		return true;
+	};
+
+	ImageRowReader reader(img);
+	segmentTiled(reader, params, img.height, collect);
+
+	SlicParams whole = params;
+	whole.step = params.gridStep(img.width, img.height);
+	whole.relabel = false;
+	check(labels == Slic(whole).segment(img).labels, "tiled segmentation in one band matches the whole image");
+
+	const size_t width = img.width;
+	bool ok = true;
+	for (unsigned bandRows : {16u, 64u}) {
+		labels.clear();
+		seams.clear();
+		segmentTiled(reader, params, bandRows, collect);
+
+		std::vector<uint8_t> seam(img.height, 0);
+		for (unsigned y : seams) {
+			seam[y] = 1;
+		}
+
+		size_t changes[2] = {0, 0}, pairs[2] = {0, 0};
+		for (size_t y = 1; y < img.height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				changes[seam[y]] += labels[y * width + x] != labels[(y - 1) * width + x];
+				pairs[seam[y]] += 1;
+			}
+		}
+
+		ok = ok && labels.size() == width * img.height && !seams.empty() &&
+			changes[1] * pairs[0] <= 1.5 * changes[0] * pairs[1];
+	}
+
+	check(ok, "tiled labels agree across seams");
+}
+
+static void writeFile(const char *path, const std::string &bytes)
+{
+	FILE *file = fopen(path, "wb");
+	fwrite(bytes.data(), 1, bytes.size(), file);
+	fclose(file);
+}
+
+// PPM and PAM files give back the pixels they were written with, and
+// RGBA PAMs lose their alpha. Headers of empty images, or of more samples
+// than the file holds, are rejected before any buffer is sized by them.
+static void checkPnm(const Image &img)
+{
+	ImageReader reader;
+	ImageWriter writer;
+	Image back(0, 0);
+	bool ok = true;
+
+	for (const char *path : {"/tmp/checks.ppm", "/tmp/checks.pam"}) {
+		ok = ok && writer.write(path, img) && reader.read(path, back) &&
+			back.width == img.width && back.height == img.height && back.data == img.data;
+		unlink(path);
+	}
+
+	const char *path = "/tmp/checks.pam";
+	writeFile(path, std::string("P7\nWIDTH 2\nHEIGHT 1\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n") +
+		std::string("\x01\x02\x03\xFF\x04\x05\x06\x00", 8));
+	ok = ok && reader.read(path, back) && back.width == 2 && back.height == 1 &&
+		back.data == std::vector<unsigned char>({1, 2, 3, 4, 5, 6});
+	check(ok, "PPM and PAM round trip");
+
+	const char *bad[] = {
+		"P6\n0 0\n255\n",
+		"P6\n0 4\n255\n",
+		"P6\n100000 100000\n255\nxyz",
+		"P6\n2 2\n255\n0123456789a",
+		"P7\nWIDTH 0\nHEIGHT 1\nDEPTH 3\nMAXVAL 255\nENDHDR\n",
+		"P7\nWIDTH 100000\nHEIGHT 100000\nDEPTH 3\nMAXVAL 255\nENDHDR\nxyz",
+	};
+
+	ok = true;
+	for (const char *bytes : bad) {
+		writeFile(path, bytes);
+		ok = ok && !reader.read(path, back) && back.width == 0 && back.data.capacity() < 1 << 20;
+	}
+	unlink(path);
+
+	check(ok, "PPM and PAM headers of empty or truncated images are rejected");
+}
+
+int main()
+{
+	Image img("img/pingpong.png");
+	if (img.data.empty())
+		return 1;
+
+	// Half size, to keep the checks quick.
+	img = img.downscale(2);
+
+	checkEmpty();
+	checkKernels();
+	checkIncremental(img);
+	checkTemporal(img);
+	checkThreads(img);
+	checkRegionGraph(img);
+	checkLabelMap(img);
+	checkTiled(img);
+	checkPnm(img);
+
+	if (failures)
+		println(failures << " checks failed");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+#include "tiled.h"
+#include "io.h"
+#include "util.h"
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+ImageRowReader::ImageRowReader(const Image &img)
+	: img(img)
+{
+	width = img.width;
+	height = img.height;
+}
+
+bool ImageRowReader::read(unsigned y, unsigned rows, unsigned char *out)
+{
+	if (y + rows > height)
+		return false;
+
+	memcpy(out, &img.data[3 * (size_t) y * width], 3 * (size_t) rows * width);
+	return true;
+}
+
+PpmRowReader::PpmRowReader(const char *fp)
+	: file(fopen(fp, "rb")), offset(0), channels(3)
+{
+	width = height = 0;
+
+	if (!file) {
+		println("[PpmRowReader error]: Could not open " << fp);
+		return;
+	}
+
+	if (!readPnmHeader(file, width, height, channels)) {
+		println("[PpmRowReader error]: " << fp << " is not a complete 8 bit binary PPM or PAM");
+		width = height = 0;
+		return;
+	}
+
+	offset = ftell(file);
+}
+
+PpmRowReader::~PpmRowReader()
+{
+	if (file)
+		fclose(file);
+}
+
+bool PpmRowReader::read(unsigned y, unsigned rows, unsigned char *out)
+{
+	if (!file || y + rows > height)
+		return false;
+
+	if (fseek(file, offset + channels * (long) y * width, SEEK_SET))
+		return false;
+
+	size_t n = (size_t) rows * width;
+	if (channels == 3)
+		return fread(out, 3, n, file) == n;
+
+	rgba.resize(4 * n);
+	if (fread(rgba.data(), 4, n, file) != n)
+		return false;
+
+	rgbaToRgb(rgba.data(), n);
+	memcpy(out, rgba.data(), 3 * n);
+	return true;
+}
+
+int32_t tiledLabels(unsigned width, unsigned height, const SlicParams &params)
+{
+	const unsigned s = params.gridStep(width, height);
+	return ((width + s - 1) / s) * ((height + s - 1) / s);
+}
+
+int32_t segmentTiled(RowReader &reader, const SlicParams &params, unsigned bandRows,
+		const LabelSink &sink)
+{
+	const unsigned width = reader.width;
+	const unsigned height = reader.height;
+	const unsigned s = params.gridStep(width, height);
+	const unsigned gridWidth = (width + s - 1) / s;
+
+	// Keep band edges on the seed grid.
+	const unsigned core = std::max((bandRows + s - 1) / s, 1u) * s;
+	const unsigned halo = 2 * s;
+
+	// Every band must use the global grid step, and labels have to stay
+	// the index of the center they belong to.
+	SlicParams bandParams = params;
+	bandParams.step = s;
+	bandParams.relabel = false;
+
+	Slic slic(bandParams);
+	Image band(width, 0);
+	band.data.reserve(3 * (size_t) width * (core + 2 * halo));
+	std::vector<int32_t> labels;
+
+	for (unsigned top = 0; top < height; top += core) {
+		unsigned rows = std::min(core, height - top);
+		unsigned y0 = top >= halo ? top - halo : 0;
+		unsigned y1 = std::min(top + core + halo, height);
+
+		band.height = y1 - y0;
+		band.data.resize(3 * (size_t) width * band.height);
+		if (!reader.read(y0, band.height, band.data.data())) {
+			println("[segmentTiled error]: Could not read rows " << y0 << "-" << y1);
+			return -1;
+		}
+
+		if (params.verbose)
+			println("Band " << top << "-" << top + rows << "/" << height);
+
+		SlicResult result = slic.segment(band);
+
+		// The band grid is the global grid shifted down by y0 / s rows.
+		const int32_t shift = (y0 / s) * gridWidth;
+		const int32_t *in = &result.labels[(size_t) (top - y0) * width];
+
+		labels.resize((size_t) rows * width);
+		for (size_t i = 0; i < labels.size(); ++i) {
+			labels[i] = in[i] < 0 ? in[i] : in[i] + shift;
+		}
+
+		if (!sink(top, rows, labels.data(), &band.data[3 * (size_t) (top - y0) * width]))
+			return -1;
+	}
+
+	return tiledLabels(width, height, params);
+}
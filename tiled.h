@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+#include "image.h"
+#include "slic.h"
+
+// Source of image rows for tiled processing. Rows may be requested more
+// than once, as neighboring bands overlap.
+struct RowReader {
+	unsigned width, height;
+
+	virtual ~RowReader() {}
+
+	// Reads the rows [y, y + rows) as RGB into <out>.
+	virtual bool read(unsigned y, unsigned rows, unsigned char *out) = 0;
+};
+
+// Reads rows from an image that is already in memory.
+struct ImageRowReader : RowReader {
+	const Image &img;
+
+	ImageRowReader(const Image &img);
+	bool read(unsigned y, unsigned rows, unsigned char *out);
+};
+
+// Streams rows from a binary PPM (P6) or PAM (P7) file with 8 bit
+// samples, without ever holding more than the requested rows in memory.
+struct PpmRowReader : RowReader {
+	FILE *file;
+	long offset;
+	unsigned channels;
+	// Rows of a PAM with alpha, before it is dropped.
+	std::vector<unsigned char> rgba;
+
+	PpmRowReader(const char *fp);
+	~PpmRowReader();
+
+	bool read(unsigned y, unsigned rows, unsigned char *out);
+};
+
+// Receives the final labels of the rows [y, y + rows), and the RGB pixels
+// of those rows. Returning false stops the segmentation.
+typedef std::function<bool(unsigned y, unsigned rows, const int32_t *labels,
+		const unsigned char *rgb)> LabelSink;
+
+// Segments an image band by band, so that peak memory is bounded by the
+// band size rather than by the image height.
+//
+// Every band of <bandRows> rows is extended by a halo of 2S rows on both
+// sides, which covers the windows of all centers that can claim a pixel
+// of the band. Band edges are placed on multiples of S, so every band
+// seeds its centers on the same global grid. Labels are the index of the
+// grid cell a center was seeded in. A superpixel that crosses a seam
+// therefore gets the same label on both sides without a stitching pass,
+// as long as the bands on both sides agree on where it ends.
+//
+// Connectivity is still enforced per band, over the band and its halo,
+// and the two bands next to a seam decide on their own. A small fragment
+// that touches the seam may be merged on one side and kept on the other,
+// or merged into another neighbor on each side. The labels of the other
+// band are final by then, so a fragment is never merged into the segment
+// across the seam. Near seams, labels may therefore differ from a
+// segmentation of the whole image.
+//
+// Bands are handed to <sink> top to bottom. Labels are -1 or below
+// tiledLabels(). Returns that number, or -1 if a read or the sink failed.
+int32_t segmentTiled(RowReader &reader, const SlicParams &params, unsigned bandRows,
+		const LabelSink &sink);
+
+// Number of cells of the seed grid of segmentTiled().
+int32_t tiledLabels(unsigned width, unsigned height, const SlicParams &params);
@@ -0,0 +1,35 @@
+#include "timer.h"
+
+double StageTimes::total() const
+{
+	double sum = decode + convert + seeding + update + connectivity + statistics + render + encode;
+	for (double t : assignment) {
+		sum += t;
+	}
+
+	return sum;
+}
+
+void StageTimes::reset()
+{
+	*this = StageTimes();
+}
+
+void StageTimes::writeJson(std::ostream &os) const
+{
+	os << "{\"decode\": " << decode
+	   << ", \"convert\": " << convert
+	   << ", \"seeding\": " << seeding
+	   << ", \"assignment\": [";
+
+	for (size_t i = 0; i < assignment.size(); ++i) {
+		os << (i ? ", " : "") << assignment[i];
+	}
+
+	os << "], \"update\": " << update
+	   << ", \"connectivity\": " << connectivity
+	   << ", \"statistics\": " << statistics
+	   << ", \"render\": " << render
+	   << ", \"encode\": " << encode
+	   << ", \"total\": " << total() << "}";
+}
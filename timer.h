@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+// Wall time in seconds spent in each stage of the pipeline. Stages that
+// run more than once accumulate.
+struct StageTimes {
+	double decode = 0.0;
+	double convert = 0.0;
+	double seeding = 0.0;
+	std::vector<double> assignment; // One entry per iteration.
+	double update = 0.0;
+	double connectivity = 0.0;
+	double statistics = 0.0;
+	double render = 0.0;
+	double encode = 0.0;
+
+	double total() const;
+	void reset();
+	void writeJson(std::ostream &os) const;
+};
+
+// Adds the wall time of its scope to <*slot>. A null slot disables the
+// timer, so optional instrumentation costs one branch.
+struct ScopedTimer {
+	double *slot;
+	std::chrono::steady_clock::time_point start;
+
+	ScopedTimer(double *slot)
+		: slot(slot)
+	{
+		if (slot)
+			start = std::chrono::steady_clock::now();
+	}
+
+	~ScopedTimer()
+	{
+		if (slot)
+			*slot += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};